@@ -0,0 +1,123 @@
+#pragma once
+
+#include "../macros.h"
+#include "common.h"
+#include "entity.h"
+#include "typeid.h"
+#include "prefab.h"
+
+namespace Alkahest
+{
+    // Forward declare World class
+    class World;
+
+    class NOT_EXPORTED BaseCommandBatch
+    {
+    public:
+        virtual ~BaseCommandBatch() = default;
+        virtual void playback(World& world) = 0;
+    };
+
+    // The queued adds and removes of a single component type, kept in the
+    // order they were recorded
+    template<typename T>
+    class NOT_EXPORTED CommandBatch : public BaseCommandBatch
+    {
+    public:
+        void add(Entity e, T component) { m_commands.push_back({ e, std::move(component) }); };
+        void remove(Entity e) { m_commands.push_back({ e, std::nullopt }); };
+
+        // Defined in world.h
+        void playback(World& world) override;
+    private:
+        struct Command
+        {
+            Entity entity;
+            std::optional<T> component;
+        };
+
+        std::vector<Command> m_commands{};
+    };
+
+    // Records structural changes (creating and destroying entities, adding
+    // and removing components) so they can be made while systems are
+    // iterating. Every thread records into its own buffer for each world,
+    // and all of a world's buffers are played back together at the end of
+    // World::update() or on World::flushCommands().
+    //
+    // Playback spawns the queued prefab batches first, then applies the
+    // commands one component type at a time, so each storage is touched
+    // once per flush, and destroys entities last.
+    class NOT_EXPORTED CommandBuffer
+    {
+    public:
+        explicit CommandBuffer(World& world) : m_world(world) {};
+
+        // The entity's ID is handed out immediately so later commands can
+        // refer to it, but the entity has no components, and may not count
+        // as alive, until the buffer is played back. Defined in world.h.
+        Entity createEntity();
+
+        // Reserves `count` entities right away and gives them the prefab's
+        // components on playback, before any other queued component
+        // changes, so addComponent can still override individual values.
+        // The prefab must outlive the playback. Defined in world.h.
+        std::vector<Entity> spawnBatch(const Prefab& prefab, size_t count);
+
+        void destroyEntity(Entity e)
+        {
+            m_destroyed.push_back(e);
+            m_empty = false;
+        };
+
+        template<typename T>
+        void addComponent(Entity e, T component)
+        {
+            batchFor<T>().add(e, std::move(component));
+        };
+
+        template<typename T>
+        void removeComponent(Entity e)
+        {
+            batchFor<T>().remove(e);
+        };
+
+        bool empty() const { return m_empty; };
+
+        // Drops every recorded change without applying it
+        void clear()
+        {
+            m_batches.clear();
+            m_spawns.clear();
+            m_destroyed.clear();
+            m_empty = true;
+        };
+    private:
+        friend class World;
+
+        template<typename T>
+        CommandBatch<T>& batchFor()
+        {
+            size_t type = TypeIndex<Component>::assign<T>();
+            if (type >= m_batches.size())
+                m_batches.resize(type + 1);
+            if (!m_batches[type])
+                m_batches[type] = std::make_unique<CommandBatch<T>>();
+
+            m_empty = false;
+            return static_cast<CommandBatch<T>&>(*m_batches[type]);
+        };
+    private:
+        struct Spawn
+        {
+            const Prefab* prefab;
+            std::vector<Entity> entities;
+        };
+
+        World& m_world;
+        std::vector<std::unique_ptr<BaseCommandBatch>> m_batches{};
+        std::vector<Spawn> m_spawns{};
+        std::vector<Entity> m_destroyed{};
+        bool m_empty = true;
+    };
+}
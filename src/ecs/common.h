@@ -1,24 +1,72 @@
 #pragma once
 
+#include "signature.h"
+
 namespace Alkahest
 {
 #ifndef ALKAHEST_ENTITY_ID_TYPE
-#define ALKAHEST_ENTITY_ID_TYPE std::uint16_t
+#define ALKAHEST_ENTITY_ID_TYPE std::uint32_t
+#endif
+
+// Entity IDs are split into an index, used to address storage, and a
+// generation in the remaining high bits that is bumped whenever the
+// index is recycled so stale IDs can be told apart from live ones
+#ifndef ALKAHEST_ENTITY_INDEX_BITS
+#define ALKAHEST_ENTITY_INDEX_BITS 22
 #endif
 
 #ifndef ALKAHEST_ENTITY_LIMIT
-#define ALKAHEST_ENTITY_LIMIT 5000
+#define ALKAHEST_ENTITY_LIMIT (static_cast<ALKAHEST_ENTITY_ID_TYPE>(1) << ALKAHEST_ENTITY_INDEX_BITS)
 #endif
 
 #ifndef ALKAHEST_COMPONENT_ID_TYPE
-#define ALKAHEST_COMPONENT_ID_TYPE std::uint8_t
+#define ALKAHEST_COMPONENT_ID_TYPE std::uint16_t
 #endif
 
+// Number of component types that can be registered. Component masks are
+// bitsets of this width, so it must be a multiple of 128.
 #ifndef ALKAHEST_COMPONENT_LIMIT
-#define ALKAHEST_COMPONENT_LIMIT 32
+#define ALKAHEST_COMPONENT_LIMIT 256
+#endif
+
+#define ALKAHEST_MASK_TYPE Alkahest::Signature<ALKAHEST_COMPONENT_LIMIT>
+
+// Components are stamped with the change tick they were last modified
+// on. Ticks wrap around, and are compared with tickAtOrAfter() so the
+// comparison stays correct across the wrap.
+#ifndef ALKAHEST_TICK_TYPE
+#define ALKAHEST_TICK_TYPE std::uint32_t
 #endif
 
-#ifndef ALKAHEST_MASK_TYPE
-#define ALKAHEST_MASK_TYPE std::uint32_t
+// Number of entity IDs covered by a single page of a component
+// array's sparse index. Pages are only allocated once an entity
+// in their range receives the component.
+#ifndef ALKAHEST_SPARSE_PAGE_SIZE
+#define ALKAHEST_SPARSE_PAGE_SIZE 1024
 #endif
+
+// Number of components stored in each page of a component array's
+// dense storage. Must be a power of two.
+#ifndef ALKAHEST_COMPONENT_PAGE_SIZE
+#define ALKAHEST_COMPONENT_PAGE_SIZE 1024
+#endif
+
+// Define ALKAHEST_ECS_ARCHETYPE_STORAGE to store components grouped by
+// entity mask in fixed-size chunks instead of one sparse set per type.
+// This sets the size in bytes of each of those chunks.
+#ifndef ALKAHEST_ARCHETYPE_CHUNK_SIZE
+#define ALKAHEST_ARCHETYPE_CHUNK_SIZE 16384
+#endif
+
+    // Whether a component stamped with `tick` changed at or after `since`.
+    // Stamps more than half the tick range older than `since` read as
+    // changed, which only ever causes extra work, never missed changes.
+    constexpr bool tickAtOrAfter(ALKAHEST_TICK_TYPE tick, ALKAHEST_TICK_TYPE since)
+    {
+        // Stored back into the tick type so ticks narrower than int
+        // still wrap around
+        using Signed = std::make_signed_t<ALKAHEST_TICK_TYPE>;
+        ALKAHEST_TICK_TYPE difference = tick - since;
+        return static_cast<Signed>(difference) >= 0;
+    }
 }
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../macros.h"
+#include "components/_base.h"
+
+namespace Alkahest
+{
+    // Components can declare `static constexpr uint32_t snapshotVersion`
+    // and bump it whenever their layout changes, so snapshots taken with
+    // the old layout are refused instead of being misread
+    template<typename T, typename = void>
+    constexpr uint32_t componentVersion = 0;
+
+    template<typename T>
+    constexpr uint32_t componentVersion<T, std::void_t<decltype(T::snapshotVersion)>> = T::snapshotVersion;
+
+    // Type-erased description of a component type, used by the archetype
+    // storage to lay out and move component data it doesn't know the
+    // static type of, and by snapshots to check that the data they hold
+    // still matches the registered types.
+    struct NOT_EXPORTED ComponentInfo
+    {
+        size_t size;
+        size_t align;
+        bool tag;
+        bool trivial;
+        const char* name;
+        uint32_t version;
+        void (*moveConstruct)(void* dst, void* src);
+        void (*copyConstruct)(void* dst, const void* src);
+        void (*destroy)(void* ptr);
+
+        template<typename T>
+        static ComponentInfo of()
+        {
+            return {
+                sizeof(T),
+                alignof(T),
+                isTag<T>,
+                std::is_trivially_copyable_v<T>,
+                typeid(T).name(),
+                componentVersion<T>,
+                [](void* dst, void* src) { new (dst) T(std::move(*static_cast<T*>(src))); },
+                [](void* dst, const void* src) { new (dst) T(*static_cast<const T*>(src)); },
+                [](void* ptr) { static_cast<T*>(ptr)->~T(); }
+            };
+        };
+    };
+}
@@ -4,6 +4,20 @@ namespace Alkahest
 {
     struct Component {};
 
+    // Components without any data (e.g. `struct Visible : Component {};`)
+    // are tags. A tag is only recorded in the entity's mask and in the
+    // storage's list of IDs, and anything asking for a tag's data is
+    // handed this shared instance.
+    template<typename T>
+    constexpr bool isTag = std::is_empty_v<T>;
+
+    template<typename T>
+    T& tagInstance()
+    {
+        static T instance{};
+        return instance;
+    }
+
     namespace Components
     {
         // This function will be defined and implemented within the
@@ -2,4 +2,5 @@
 
 #include "_base.h"
 #include "transform.h"
+#include "parent.h"
 
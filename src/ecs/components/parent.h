@@ -0,0 +1,17 @@
+#pragma once
+
+#include "_base.h"
+#include "../entity.h"
+
+namespace Alkahest
+{
+    namespace Components
+    {
+        // Makes an entity's TransformComponent relative to its parent's.
+        // Parents without a TransformComponent are ignored.
+        struct ParentComponent : Component
+        {
+            Entity Parent;
+        };
+    }
+}
@@ -6,17 +6,27 @@
 
 namespace Alkahest
 {
-    // Forward declare EntityManager class
+    // Forward declare EntityManager and View classes
     class EntityManager;
-    
+    template<typename... Ts> class View;
+
+    constexpr ALKAHEST_ENTITY_ID_TYPE entityIndex(ALKAHEST_ENTITY_ID_TYPE id)
+    {
+        return id & ((static_cast<ALKAHEST_ENTITY_ID_TYPE>(1) << ALKAHEST_ENTITY_INDEX_BITS) - 1);
+    }
+
+    constexpr ALKAHEST_ENTITY_ID_TYPE entityGeneration(ALKAHEST_ENTITY_ID_TYPE id)
+    {
+        return id >> ALKAHEST_ENTITY_INDEX_BITS;
+    }
+
     class API Entity
     {
     public:
         friend class EntityManager;
-        ~Entity() {};
+        template<typename... Ts> friend class View;
 
         ALKAHEST_ENTITY_ID_TYPE ID;
-        ALKAHEST_MASK_TYPE Mask;
 
         template<typename T>
         void addComponent(T& c);
@@ -24,12 +34,15 @@ namespace Alkahest
         template<typename T>
         T& getComponent();
 
+        // Read-only access, which leaves the change tick alone
+        template<typename T>
+        const T& readComponent();
+
         template<typename T>
         void removeComponent();
     public:
         static Entity create();
     private:
-        Entity(ALKAHEST_ENTITY_ID_TYPE id, ALKAHEST_MASK_TYPE mask) :
-            ID(id), Mask(mask) {};
+        Entity(ALKAHEST_ENTITY_ID_TYPE id) : ID(id) {};
     };
 }
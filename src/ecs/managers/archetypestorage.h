@@ -0,0 +1,635 @@
+#pragma once
+
+#include "../../macros.h"
+#include "../common.h"
+#include "../entity.h"
+#include "../componentinfo.h"
+#include "../snapshot.h"
+#include "../../sys/log/log.h"
+
+namespace Alkahest
+{
+    // A group of entities that all share the same component mask. Each
+    // archetype stores its entities in fixed-size chunks, and each chunk
+    // holds one contiguous column per component type (SoA), so queries
+    // over several components stream through memory instead of doing a
+    // random lookup per component. Every component column is paired with
+    // a column of the ticks its components last changed on. Tags are part
+    // of the archetype's mask but get no columns.
+    class NOT_EXPORTED Archetype
+    {
+    public:
+        static constexpr size_t columnAlignment = 64;
+        static constexpr uint32_t noColumn = std::numeric_limits<uint32_t>::max();
+
+        struct Chunk
+        {
+            std::byte* data;
+            uint32_t count;
+        };
+
+        Archetype(ALKAHEST_MASK_TYPE mask, const std::vector<ComponentInfo>& infos)
+            : m_mask(mask)
+        {
+            m_columnOf.fill(noColumn);
+
+            size_t rowSize = sizeof(ALKAHEST_ENTITY_ID_TYPE);
+            mask.forEach([&](size_t type) {
+                if (infos[type].tag)
+                    return;
+
+                m_columnOf[type] = static_cast<uint32_t>(m_columns.size());
+                m_columns.push_back({ static_cast<ALKAHEST_COMPONENT_ID_TYPE>(type), 0, 0, infos[type] });
+                rowSize += infos[type].size + sizeof(ALKAHEST_TICK_TYPE);
+            });
+
+            // Reserve worst-case padding for every column up front so the
+            // aligned columns are guaranteed to fit in the chunk
+            size_t padding = (2 * m_columns.size() + 1) * columnAlignment;
+            if (ALKAHEST_ARCHETYPE_CHUNK_SIZE <= padding
+                    || (ALKAHEST_ARCHETYPE_CHUNK_SIZE - padding) / rowSize == 0)
+            {
+                logError("Archetype row does not fit in a chunk! Row size: {}", rowSize);
+                throw AlkahestError{};
+            }
+            m_capacity = static_cast<uint32_t>((ALKAHEST_ARCHETYPE_CHUNK_SIZE - padding) / rowSize);
+
+            size_t offset = alignUp(sizeof(ALKAHEST_ENTITY_ID_TYPE) * m_capacity);
+            for (Column& c : m_columns)
+            {
+                c.offset = offset;
+                offset = alignUp(offset + c.info.size * m_capacity);
+                c.tickOffset = offset;
+                offset = alignUp(offset + sizeof(ALKAHEST_TICK_TYPE) * m_capacity);
+            }
+        };
+
+        ~Archetype()
+        {
+            for (Chunk& chunk : m_chunks)
+            {
+                for (Column& c : m_columns)
+                {
+                    for (uint32_t row = 0; row < chunk.count; row++)
+                        c.info.destroy(chunk.data + c.offset + c.info.size * row);
+                }
+                ::operator delete(chunk.data, std::align_val_t(columnAlignment));
+            }
+        };
+
+        Archetype(const Archetype&) = delete;
+        Archetype& operator=(const Archetype&) = delete;
+
+        ALKAHEST_MASK_TYPE getMask() const { return m_mask; };
+        uint32_t getChunkCapacity() const { return m_capacity; };
+        size_t size() const { return m_size; };
+
+        std::vector<Chunk>& getChunks() { return m_chunks; };
+        const std::vector<Chunk>& getChunks() const { return m_chunks; };
+
+        bool hasColumn(ALKAHEST_COMPONENT_ID_TYPE type) const
+        {
+            return m_columnOf[type] != noColumn;
+        };
+
+        ALKAHEST_ENTITY_ID_TYPE* entities(const Chunk& chunk) const
+        {
+            return reinterpret_cast<ALKAHEST_ENTITY_ID_TYPE*>(chunk.data);
+        };
+
+        ALKAHEST_ENTITY_ID_TYPE entityAt(uint32_t row) const
+        {
+            return entities(m_chunks[row / m_capacity])[row % m_capacity];
+        };
+
+        template<typename T>
+        T* column(const Chunk& chunk, ALKAHEST_COMPONENT_ID_TYPE type) const
+        {
+            return reinterpret_cast<T*>(chunk.data + m_columns[m_columnOf[type]].offset);
+        };
+
+        ALKAHEST_TICK_TYPE* ticks(const Chunk& chunk, ALKAHEST_COMPONENT_ID_TYPE type) const
+        {
+            return reinterpret_cast<ALKAHEST_TICK_TYPE*>(chunk.data + m_columns[m_columnOf[type]].tickOffset);
+        };
+
+        void* get(uint32_t row, ALKAHEST_COMPONENT_ID_TYPE type)
+        {
+            const Column& c = m_columns[m_columnOf[type]];
+            const Chunk& chunk = m_chunks[row / m_capacity];
+            return chunk.data + c.offset + c.info.size * (row % m_capacity);
+        };
+
+        ALKAHEST_TICK_TYPE& tickAt(uint32_t row, ALKAHEST_COMPONENT_ID_TYPE type)
+        {
+            return ticks(m_chunks[row / m_capacity], type)[row % m_capacity];
+        };
+
+        // Appends an uninitialized row for the entity and returns its index.
+        // The caller is responsible for constructing every column.
+        uint32_t allocateRow(ALKAHEST_ENTITY_ID_TYPE id)
+        {
+            Chunk& chunk = chunkWithSpace();
+            entities(chunk)[chunk.count] = id;
+            chunk.count++;
+            return static_cast<uint32_t>(m_size++);
+        };
+
+        // Appends a row for each entity, with every column copied from
+        // `values` (indexed by component type) and stamped with `tick`.
+        // Rows are filled a chunk at a time and trivially copyable
+        // components are memcpy'd. Returns the index of the first row.
+        uint32_t appendRows(const Entity* ids, size_t count,
+            const std::array<const void*, ALKAHEST_COMPONENT_LIMIT>& values, ALKAHEST_TICK_TYPE tick)
+        {
+            uint32_t first = static_cast<uint32_t>(m_size);
+            for (size_t done = 0; done < count;)
+            {
+                Chunk& chunk = chunkWithSpace();
+                uint32_t n = static_cast<uint32_t>(std::min<size_t>(count - done, m_capacity - chunk.count));
+
+                ALKAHEST_ENTITY_ID_TYPE* rowIDs = entities(chunk) + chunk.count;
+                for (uint32_t i = 0; i < n; i++)
+                    rowIDs[i] = ids[done + i].ID;
+
+                for (Column& c : m_columns)
+                {
+                    std::byte* dst = chunk.data + c.offset + c.info.size * chunk.count;
+                    const void* src = values[c.type];
+                    for (uint32_t i = 0; i < n; i++)
+                    {
+                        if (c.info.trivial)
+                            std::memcpy(dst + c.info.size * i, src, c.info.size);
+                        else
+                            c.info.copyConstruct(dst + c.info.size * i, src);
+                    }
+                    std::fill_n(ticks(chunk, c.type) + chunk.count, n, tick);
+                }
+
+                chunk.count += n;
+                m_size += n;
+                done += n;
+            }
+            return first;
+        };
+
+        // Appends a row for each of the `count` IDs packed in `ids`, with
+        // every column copied from the block of `count` packed components
+        // in `columns` (indexed by component type) and stamped with `tick`.
+        // Neither needs to be aligned, and every column must be trivially
+        // copyable. Returns the index of the first row.
+        uint32_t appendColumns(const std::byte* ids, size_t count,
+            const std::array<const std::byte*, ALKAHEST_COMPONENT_LIMIT>& columns, ALKAHEST_TICK_TYPE tick)
+        {
+            uint32_t first = static_cast<uint32_t>(m_size);
+            for (size_t done = 0; done < count;)
+            {
+                Chunk& chunk = chunkWithSpace();
+                uint32_t n = static_cast<uint32_t>(std::min<size_t>(count - done, m_capacity - chunk.count));
+
+                std::memcpy(entities(chunk) + chunk.count, ids + sizeof(ALKAHEST_ENTITY_ID_TYPE) * done,
+                    sizeof(ALKAHEST_ENTITY_ID_TYPE) * n);
+                for (Column& c : m_columns)
+                {
+                    std::memcpy(chunk.data + c.offset + c.info.size * chunk.count,
+                        columns[c.type] + c.info.size * done, c.info.size * n);
+                    std::fill_n(ticks(chunk, c.type) + chunk.count, n, tick);
+                }
+
+                chunk.count += n;
+                m_size += n;
+                done += n;
+            }
+            return first;
+        };
+
+        // Fills the hole left at a row whose columns have already been
+        // destroyed or moved out by moving the last row into it. Returns
+        // the ID of the entity that now lives at the row, or the removed
+        // ID itself if the row was the last one.
+        ALKAHEST_ENTITY_ID_TYPE freeRow(uint32_t row)
+        {
+            uint32_t last = static_cast<uint32_t>(m_size - 1);
+            Chunk& lastChunk = m_chunks.back();
+            ALKAHEST_ENTITY_ID_TYPE movedID = entities(lastChunk)[lastChunk.count - 1];
+
+            if (row != last)
+            {
+                for (Column& c : m_columns)
+                {
+                    void* src = get(last, c.type);
+                    c.info.moveConstruct(get(row, c.type), src);
+                    c.info.destroy(src);
+                    tickAt(row, c.type) = tickAt(last, c.type);
+                }
+                entities(m_chunks[row / m_capacity])[row % m_capacity] = movedID;
+            }
+
+            lastChunk.count--;
+            m_size--;
+            if (lastChunk.count == 0)
+            {
+                ::operator delete(lastChunk.data, std::align_val_t(columnAlignment));
+                m_chunks.pop_back();
+            }
+
+            return movedID;
+        };
+
+        // Rebuilds the chunks with the rows in a new order, where order[i]
+        // is the current index of the row that should end up at index i.
+        // Rows are moved into freshly allocated chunks one at a time, so
+        // the archetype briefly takes up twice its memory.
+        void reorder(const std::vector<uint32_t>& order)
+        {
+            std::vector<Chunk> old = std::move(m_chunks);
+            m_chunks.clear();
+            m_size = 0;
+
+            for (uint32_t from : order)
+            {
+                const Chunk& src = old[from / m_capacity];
+                uint32_t srcRow = from % m_capacity;
+                uint32_t row = allocateRow(entities(src)[srcRow]);
+                for (Column& c : m_columns)
+                {
+                    void* data = src.data + c.offset + c.info.size * srcRow;
+                    c.info.moveConstruct(get(row, c.type), data);
+                    c.info.destroy(data);
+                    tickAt(row, c.type) = ticks(src, c.type)[srcRow];
+                }
+            }
+
+            for (Chunk& chunk : old)
+                ::operator delete(chunk.data, std::align_val_t(columnAlignment));
+        };
+
+        // Cached transitions to the archetype reached by adding or
+        // removing a single component type from this one
+        std::array<uint32_t, ALKAHEST_COMPONENT_LIMIT> addEdges{};
+        std::array<uint32_t, ALKAHEST_COMPONENT_LIMIT> removeEdges{};
+    private:
+        struct Column
+        {
+            ALKAHEST_COMPONENT_ID_TYPE type;
+            size_t offset;
+            size_t tickOffset;
+            ComponentInfo info;
+        };
+
+        static size_t alignUp(size_t n)
+        {
+            return (n + columnAlignment - 1) & ~(columnAlignment - 1);
+        };
+
+        Chunk& chunkWithSpace()
+        {
+            if (m_chunks.empty() || m_chunks.back().count == m_capacity)
+            {
+                std::byte* data = static_cast<std::byte*>(::operator new(
+                    ALKAHEST_ARCHETYPE_CHUNK_SIZE, std::align_val_t(columnAlignment)));
+                m_chunks.push_back({ data, 0 });
+            }
+            return m_chunks.back();
+        };
+
+        ALKAHEST_MASK_TYPE m_mask;
+        uint32_t m_capacity{};
+        size_t m_size{};
+        std::vector<Column> m_columns{};
+        std::array<uint32_t, ALKAHEST_COMPONENT_LIMIT> m_columnOf{};
+        std::vector<Chunk> m_chunks{};
+    };
+
+    // Alternative to the per-type ComponentArray storage that groups
+    // entities by their exact component mask. Selected at compile time
+    // with ALKAHEST_ECS_ARCHETYPE_STORAGE.
+    class NOT_EXPORTED ArchetypeStorage
+    {
+    public:
+        static constexpr uint32_t noArchetype = std::numeric_limits<uint32_t>::max();
+
+        void registerType(ALKAHEST_COMPONENT_ID_TYPE type, ComponentInfo info)
+        {
+            if (m_infos.size() <= type)
+                m_infos.resize(static_cast<size_t>(type) + 1);
+            m_infos[type] = info;
+        };
+
+        template<typename T>
+        void insertData(Entity e, ALKAHEST_COMPONENT_ID_TYPE type, T component, ALKAHEST_TICK_TYPE tick)
+        {
+            if constexpr (isTag<T>)
+            {
+                if (!has(e, type))
+                    moveEntity(e.ID, type, true);
+                return;
+            }
+
+            if (void* existing = getData(e, type))
+            {
+                *static_cast<T*>(existing) = component;
+                *getTick(e, type) = tick;
+                return;
+            }
+
+            void* slot = moveEntity(e.ID, type, true);
+            new (slot) T(std::move(component));
+            *getTick(e, type) = tick;
+        };
+
+        bool has(Entity e, ALKAHEST_COMPONENT_ID_TYPE type)
+        {
+            Location* l = find(e.ID);
+            return l != nullptr && m_archetypes[l->archetype]->getMask().test(type);
+        };
+
+        // The component's data, or nullptr if the entity doesn't have it
+        // or it is a tag
+        void* getData(Entity e, ALKAHEST_COMPONENT_ID_TYPE type)
+        {
+            Location* l = find(e.ID);
+            if (l == nullptr || !m_archetypes[l->archetype]->hasColumn(type))
+                return nullptr;
+
+            return m_archetypes[l->archetype]->get(l->row, type);
+        };
+
+        ALKAHEST_TICK_TYPE* getTick(Entity e, ALKAHEST_COMPONENT_ID_TYPE type)
+        {
+            Location* l = find(e.ID);
+            if (l == nullptr || !m_archetypes[l->archetype]->hasColumn(type))
+                return nullptr;
+
+            return &m_archetypes[l->archetype]->tickAt(l->row, type);
+        };
+
+        // Places entities that have no components yet straight into the
+        // archetype for `mask`, without passing through the archetypes of
+        // each component subset on the way
+        void insertBatch(const Entity* entities, size_t count, ALKAHEST_MASK_TYPE mask,
+            const std::array<const void*, ALKAHEST_COMPONENT_LIMIT>& values, ALKAHEST_TICK_TYPE tick)
+        {
+            if (count == 0 || mask.none())
+                return;
+
+            ALKAHEST_ENTITY_ID_TYPE maxIndex = 0;
+            for (size_t i = 0; i < count; i++)
+                maxIndex = std::max(maxIndex, entityIndex(entities[i].ID));
+            if (maxIndex >= m_locations.size())
+                m_locations.resize(static_cast<size_t>(maxIndex) + 1, { noArchetype, 0 });
+
+            uint32_t archetype = findOrCreateArchetype(mask);
+            uint32_t row = m_archetypes[archetype]->appendRows(entities, count, values, tick);
+            for (size_t i = 0; i < count; i++)
+                m_locations[entityIndex(entities[i].ID)] = { archetype, row + static_cast<uint32_t>(i) };
+        };
+
+        void removeData(Entity e, ALKAHEST_COMPONENT_ID_TYPE type)
+        {
+            if (!has(e, type))
+                return;
+
+            moveEntity(e.ID, type, false);
+        };
+
+        void EntityDestroyed(Entity e)
+        {
+            Location* l = find(e.ID);
+            if (l == nullptr)
+                return;
+
+            Archetype& a = *m_archetypes[l->archetype];
+            a.getMask().forEach([&](size_t type) {
+                ALKAHEST_COMPONENT_ID_TYPE t = static_cast<ALKAHEST_COMPONENT_ID_TYPE>(type);
+                if (a.hasColumn(t))
+                    m_infos[t].destroy(a.get(l->row, t));
+            });
+            releaseRow(a, l->row);
+            *l = { noArchetype, 0 };
+        };
+
+        // Writes every non-empty archetype as its mask, a block of entity
+        // IDs and one block per component column. Only trivially copyable
+        // components can be saved.
+        void save(Snapshot& out) const
+        {
+            uint32_t count = 0;
+            for (auto const& a : m_archetypes)
+            {
+                if (a->size() > 0)
+                    count++;
+            }
+            out.write(count);
+
+            for (auto const& a : m_archetypes)
+            {
+                if (a->size() == 0)
+                    continue;
+
+                out.write(a->getMask());
+                out.write<uint64_t>(a->size());
+                for (const Archetype::Chunk& chunk : a->getChunks())
+                    out.write(a->entities(chunk), sizeof(ALKAHEST_ENTITY_ID_TYPE) * chunk.count);
+
+                a->getMask().forEach([&](size_t type) {
+                    ALKAHEST_COMPONENT_ID_TYPE t = static_cast<ALKAHEST_COMPONENT_ID_TYPE>(type);
+                    if (!a->hasColumn(t))
+                        return;
+
+                    const ComponentInfo& info = m_infos[t];
+                    if (!info.trivial)
+                    {
+                        logError("Only trivially copyable components can be saved in a snapshot! Type: {}", info.name);
+                        throw AlkahestError{};
+                    }
+                    for (const Archetype::Chunk& chunk : a->getChunks())
+                        out.write(a->column<std::byte>(chunk, t), info.size * chunk.count);
+                });
+            }
+        };
+
+        // Replaces every archetype with those written by save(), copying
+        // each block into the chunks a chunk at a time. `types` are the
+        // component types the snapshot's type table listed.
+        void load(Snapshot::Reader& in, ALKAHEST_TICK_TYPE tick, ALKAHEST_MASK_TYPE types)
+        {
+            clear();
+
+            uint32_t count = in.read<uint32_t>();
+            for (uint32_t i = 0; i < count; i++)
+            {
+                ALKAHEST_MASK_TYPE mask = in.read<ALKAHEST_MASK_TYPE>();
+                if (!types.contains(mask))
+                {
+                    logError("Snapshot archetype contains an unregistered component type!");
+                    throw AlkahestError{};
+                }
+                size_t rows = in.read<uint64_t>();
+                in.checkCount(rows, sizeof(ALKAHEST_ENTITY_ID_TYPE));
+                const std::byte* ids = in.skip(sizeof(ALKAHEST_ENTITY_ID_TYPE) * rows);
+
+                std::array<const std::byte*, ALKAHEST_COMPONENT_LIMIT> columns{};
+                mask.forEach([&](size_t type) {
+                    if (!m_infos[type].tag)
+                        columns[type] = in.skip(m_infos[type].size * rows);
+                });
+
+                uint32_t archetype = findOrCreateArchetype(mask);
+                Archetype& a = *m_archetypes[archetype];
+                uint32_t first = a.appendColumns(ids, rows, columns, tick);
+                for (uint32_t row = first; row < first + rows; row++)
+                {
+                    ALKAHEST_ENTITY_ID_TYPE index = entityIndex(a.entityAt(row));
+                    if (index >= m_locations.size())
+                        m_locations.resize(static_cast<size_t>(index) + 1, { noArchetype, 0 });
+                    m_locations[index] = { archetype, row };
+                }
+            }
+        };
+
+        // Destroys every stored component. Registered types are kept.
+        void clear()
+        {
+            m_archetypes.clear();
+            m_archetypeIndex.clear();
+            m_locations.clear();
+        };
+
+        // Sorts the rows of every archetype with a column of the type by
+        // `compare(const void*, const void*)` on that column. Rows that
+        // compare equal keep their relative order.
+        template<typename Compare>
+        void sort(ALKAHEST_COMPONENT_ID_TYPE type, Compare compare)
+        {
+            for (auto& a : m_archetypes)
+            {
+                if (!a->hasColumn(type) || a->size() < 2)
+                    continue;
+
+                std::vector<uint32_t> order(a->size());
+                std::iota(order.begin(), order.end(), 0u);
+                std::stable_sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+                    return compare(a->get(x, type), a->get(y, type));
+                });
+                a->reorder(order);
+
+                for (uint32_t row = 0; row < a->size(); row++)
+                    m_locations[entityIndex(a->entityAt(row))].row = row;
+            }
+        };
+
+        std::vector<std::unique_ptr<Archetype>>& getArchetypes() { return m_archetypes; };
+    private:
+        struct Location
+        {
+            uint32_t archetype;
+            uint32_t row;
+        };
+
+        // Returns the location of a live entity that is stored in some
+        // archetype, checking the full ID so stale IDs don't resolve
+        Location* find(ALKAHEST_ENTITY_ID_TYPE id)
+        {
+            ALKAHEST_ENTITY_ID_TYPE index = entityIndex(id);
+            if (index >= m_locations.size())
+                return nullptr;
+
+            Location& l = m_locations[index];
+            if (l.archetype == noArchetype || m_archetypes[l.archetype]->entityAt(l.row) != id)
+                return nullptr;
+
+            return &l;
+        };
+
+        uint32_t findOrCreateArchetype(ALKAHEST_MASK_TYPE mask)
+        {
+            auto i = m_archetypeIndex.find(mask);
+            if (i != m_archetypeIndex.end())
+                return i->second;
+
+            uint32_t index = static_cast<uint32_t>(m_archetypes.size());
+            auto a = std::make_unique<Archetype>(mask, m_infos);
+            a->addEdges.fill(noArchetype);
+            a->removeEdges.fill(noArchetype);
+            m_archetypes.push_back(std::move(a));
+            m_archetypeIndex.insert({ mask, index });
+            return index;
+        };
+
+        // Moves an entity to the archetype with the given component type
+        // added or removed, carrying over every shared column. When adding,
+        // returns the uninitialized slot for the new component, or nullptr
+        // for a tag.
+        void* moveEntity(ALKAHEST_ENTITY_ID_TYPE id, ALKAHEST_COMPONENT_ID_TYPE type, bool adding)
+        {
+            ALKAHEST_ENTITY_ID_TYPE index = entityIndex(id);
+            if (index >= m_locations.size())
+                m_locations.resize(static_cast<size_t>(index) + 1, { noArchetype, 0 });
+
+            Location& l = m_locations[index];
+            if (l.archetype != noArchetype && m_archetypes[l.archetype]->entityAt(l.row) != id)
+            {
+                logError("Attempting to modify the components of a destroyed entity!");
+                throw AlkahestError{};
+            }
+            Archetype* src = l.archetype == noArchetype ? nullptr : m_archetypes[l.archetype].get();
+
+            // Find the destination archetype, going through the cached edge
+            // when one exists to skip the mask lookup
+            uint32_t dstIndex = noArchetype;
+            if (src != nullptr)
+                dstIndex = adding ? src->addEdges[type] : src->removeEdges[type];
+            if (dstIndex == noArchetype)
+            {
+                ALKAHEST_MASK_TYPE mask = src != nullptr ? src->getMask() : ALKAHEST_MASK_TYPE{};
+                if (adding)
+                    mask.set(type);
+                else
+                    mask.reset(type);
+                if (mask.any())
+                    dstIndex = findOrCreateArchetype(mask);
+
+                // Creating an archetype may reallocate the list
+                src = l.archetype == noArchetype ? nullptr : m_archetypes[l.archetype].get();
+                if (src != nullptr && dstIndex != noArchetype)
+                    (adding ? src->addEdges : src->removeEdges)[type] = dstIndex;
+            }
+
+            Archetype* dst = dstIndex == noArchetype ? nullptr : m_archetypes[dstIndex].get();
+            uint32_t dstRow = dst != nullptr ? dst->allocateRow(id) : 0;
+
+            if (src != nullptr)
+            {
+                src->getMask().forEach([&](size_t component) {
+                    ALKAHEST_COMPONENT_ID_TYPE t = static_cast<ALKAHEST_COMPONENT_ID_TYPE>(component);
+                    if (!src->hasColumn(t))
+                        return;
+
+                    void* from = src->get(l.row, t);
+                    if (dst != nullptr && dst->hasColumn(t))
+                    {
+                        m_infos[t].moveConstruct(dst->get(dstRow, t), from);
+                        dst->tickAt(dstRow, t) = src->tickAt(l.row, t);
+                    }
+                    m_infos[t].destroy(from);
+                });
+                releaseRow(*src, l.row);
+            }
+
+            l = { dstIndex, dstRow };
+            return adding && dst->hasColumn(type) ? dst->get(dstRow, type) : nullptr;
+        };
+
+        void releaseRow(Archetype& a, uint32_t row)
+        {
+            ALKAHEST_ENTITY_ID_TYPE movedID = a.freeRow(row);
+            m_locations[entityIndex(movedID)].row = row;
+        };
+    private:
+        std::vector<ComponentInfo> m_infos{};
+        std::vector<std::unique_ptr<Archetype>> m_archetypes{};
+        std::unordered_map<ALKAHEST_MASK_TYPE, uint32_t> m_archetypeIndex{};
+        std::vector<Location> m_locations{};
+    };
+}
@@ -2,8 +2,19 @@
 
 #include "../../macros.h"
 #include "../common.h"
+#include "../entity.h"
+#include "../pagedarray.h"
+#include "../sparseindex.h"
+#include "../typeid.h"
+#include "../prefab.h"
+#include "../componentinfo.h"
+#include "../snapshot.h"
 #include "../../sys/log/log.h"
 
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+#include "archetypestorage.h"
+#endif
+
 namespace Alkahest
 {
     class NOT_EXPORTED BaseComponentArray
@@ -11,64 +22,335 @@ namespace Alkahest
     public:
         virtual ~BaseComponentArray() = default;
         virtual void EntityDestroyed(Entity e) = 0;
+
+        // Gives every entity in the batch a copy of the component pointed
+        // to by `component`. The entities must not have the component yet.
+        virtual void insertBatch(const Entity* entities, size_t count,
+            const void* component, ALKAHEST_TICK_TYPE tick) = 0;
+
+        // Writes the entity IDs and then the component data as contiguous
+        // blocks. Only trivially copyable components can be saved.
+        virtual void save(Snapshot& out) const = 0;
+
+        // Replaces the contents with what save() wrote, stamping every
+        // component as changed on `tick`
+        virtual void load(Snapshot::Reader& in, ALKAHEST_TICK_TYPE tick) = 0;
+
+        virtual void clear() = 0;
+
+        // An empty array of the same component type, so a snapshot can be
+        // loaded next to the live one and swapped in once it is checked
+        virtual std::unique_ptr<BaseComponentArray> makeEmpty() const = 0;
+        virtual void swap(BaseComponentArray& other) = 0;
     };
 
+    // Component storage is a paged sparse set: the sparse side maps an
+    // entity index to a slot in the dense arrays, and the dense side keeps
+    // the owning entity IDs, the component data and the tick each
+    // component last changed on packed side by side.
+    // Lookups are two array loads and iterating the dense arrays is a
+    // linear walk over contiguous memory. Component data lives in pages
+    // that are allocated as the array grows and never relocated. Tags
+    // only keep the IDs.
     template<typename T>
     class NOT_EXPORTED ComponentArray : public BaseComponentArray
     {
     public:
-        void insertData(Entity e, T component)
+        using Index = SparseIndex::Index;
+        using Storage = PagedArray<T, ALKAHEST_COMPONENT_PAGE_SIZE>;
+        static constexpr Index nullIndex = SparseIndex::null;
+
+        void insertData(Entity e, T component, ALKAHEST_TICK_TYPE tick)
+        {
+            Index& slot = sparseSlot(e.ID);
+
+            // Re-adding an existing component just overwrites the data, as
+            // long as the slot isn't owned by another generation of the index
+            if (slot != nullIndex)
+            {
+                if (m_dense[slot] != e.ID)
+                {
+                    logError("Attempting to add a component to a destroyed entity!");
+                    throw AlkahestError{};
+                }
+                if constexpr (!isTag<T>)
+                {
+                    m_componentArray[slot] = component;
+                    m_changed[slot] = tick;
+                }
+                return;
+            }
+
+            slot = static_cast<Index>(m_dense.size());
+            m_dense.push_back(e.ID);
+            if constexpr (!isTag<T>)
+            {
+                m_changed.push_back(tick);
+                m_componentArray.push_back(component);
+            }
+        };
+
+        void insertBatch(const Entity* entities, size_t count,
+            const void* component, ALKAHEST_TICK_TYPE tick) override
         {
-            size_t newIndex = m_size;
-            m_mEntityToIndex[e.ID] = newIndex;
-            m_mIndexToEntity[newIndex] = e.ID;
-            m_componentArray[newIndex] = component;
-            m_size++;
+            Index first = static_cast<Index>(m_dense.size());
+            m_dense.reserve(m_dense.size() + count);
+            for (size_t i = 0; i < count; i++)
+            {
+                sparseSlot(entities[i].ID) = first + static_cast<Index>(i);
+                m_dense.push_back(entities[i].ID);
+            }
+            if constexpr (!isTag<T>)
+            {
+                m_changed.resize(m_changed.size() + count, tick);
+                m_componentArray.append(count, *static_cast<const T*>(component));
+            }
         };
 
         void removeData(Entity e)
         {
-            // Copy the element at the end of the array into the deleted
+            Index indexOfRemovedEntity = indexOf(e.ID);
+            if (indexOfRemovedEntity == nullIndex)
+                return;
+
+            // Move the element at the end of the array into the deleted
             // element's place to maintain the density of the array
-            size_t indexOfRemovedEntity = m_mEntityToIndex[e.ID];
-            size_t indexOfLastElement = m_size - 1;
-            m_componentArray[indexOfRemovedEntity] =
-                m_componentArray[indexOfLastElement];
+            Index indexOfLastElement = static_cast<Index>(m_dense.size() - 1);
+            ALKAHEST_ENTITY_ID_TYPE lastID = m_dense[indexOfLastElement];
+            m_dense[indexOfRemovedEntity] = lastID;
+            if constexpr (!isTag<T>)
+            {
+                m_componentArray[indexOfRemovedEntity] =
+                    std::move(m_componentArray[indexOfLastElement]);
+                m_changed[indexOfRemovedEntity] = m_changed[indexOfLastElement];
+                m_componentArray.pop_back();
+                m_changed.pop_back();
+            }
+
+            // Update the sparse index for the moved and removed entities
+            sparseSlot(lastID) = indexOfRemovedEntity;
+            sparseSlot(e.ID) = nullIndex;
 
-            // Update the maps so for the new indices
-            ALKAHEST_ENTITY_ID_TYPE id = m_mIndexToEntity[indexOfLastElement];
-            m_mEntityToIndex[id] = indexOfRemovedEntity;
-            m_mIndexToEntity[indexOfRemovedEntity] = id;
+            m_dense.pop_back();
+        };
 
-            m_mEntityToIndex.erase(e.ID);
-            m_mIndexToEntity.erase(indexOfLastElement);
+        // Returns nullptr instead of throwing, for callers that are
+        // already iterating over IDs that may not have the component
+        T* tryGetData(ALKAHEST_ENTITY_ID_TYPE id)
+        {
+            Index index = indexOf(id);
+            if (index == nullIndex)
+                return nullptr;
+            return &at(index);
+        };
 
-            m_size--;
+        // Mutable access, which stamps the component as changed on `tick`
+        T& getData(Entity e, ALKAHEST_TICK_TYPE tick)
+        {
+            T& data = readData(e);
+            if constexpr (!isTag<T>)
+                m_changed[indexOf(e.ID)] = tick;
+            return data;
         };
 
-        T& getData(Entity e)
+        T& readData(Entity e)
         {
-            logTrace("in getData()");
-            if (m_mEntityToIndex.find(e.ID) == m_mEntityToIndex.end())
+            Index index = indexOf(e.ID);
+            if (index == nullIndex)
             {
                 logError("Attempting to retrieve non-existent component!");
                 //TODO: Create relevant ECS errors
                 throw AlkahestError{};
             }
 
-            return m_componentArray[m_mEntityToIndex[e.ID]];
+            return at(index);
+        };
+
+        // The component in a dense slot
+        T& at(Index index)
+        {
+            if constexpr (isTag<T>)
+                return tagInstance<T>();
+            else
+                return m_componentArray[index];
+        };
+
+        bool contains(ALKAHEST_ENTITY_ID_TYPE id) const
+        {
+            return indexOf(id) != nullIndex;
+        };
+
+        // Position of the ID in the dense arrays, or nullIndex
+        Index find(ALKAHEST_ENTITY_ID_TYPE id) const
+        {
+            return indexOf(id);
         };
 
+        size_t size() const { return m_dense.size(); };
+
+        // Dense views used for linear iteration, index i of one
+        // belongs to index i of the other. Tags have no ticks or data.
+        const ALKAHEST_ENTITY_ID_TYPE* entities() const { return m_dense.data(); };
+        ALKAHEST_TICK_TYPE* ticks() { return m_changed.data(); };
+        Storage& data() { return m_componentArray; };
+
         void EntityDestroyed(Entity e) override
         {
-            if (m_mEntityToIndex.find(e.ID) != m_mEntityToIndex.end())
-                removeData(e);
+            removeData(e);
+        };
+
+        // Reorders the dense arrays so the components are in ascending
+        // order by `compare(const T&, const T&)`. Components that compare
+        // equal keep their relative order. The order holds until the next
+        // removal, which swaps the last component into the hole.
+        template<typename Compare>
+        void sort(Compare compare)
+        {
+            static_assert(!isTag<T>, "Tags have no data to sort by");
+
+            std::vector<Index> order(m_dense.size());
+            std::iota(order.begin(), order.end(), Index{ 0 });
+            std::stable_sort(order.begin(), order.end(), [&](Index a, Index b) {
+                return compare(std::as_const(m_componentArray[a]), std::as_const(m_componentArray[b]));
+            });
+
+            // order[i] is the slot whose element belongs at i. Walk each
+            // cycle of the permutation, swapping elements into place.
+            for (Index i = 0; i < order.size(); i++)
+            {
+                Index current = i;
+                while (order[current] != i)
+                {
+                    Index next = order[current];
+                    swapSlots(current, next);
+                    order[current] = current;
+                    current = next;
+                }
+                order[current] = current;
+            }
+        };
+
+        // Moves the entities that also appear in `ids` to the front of the
+        // dense arrays, in the same order as in `ids`, so another storage's
+        // order can be mirrored. The remaining entities follow in no
+        // particular order.
+        void arrange(const ALKAHEST_ENTITY_ID_TYPE* ids, size_t count)
+        {
+            Index next = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                Index index = indexOf(ids[i]);
+                if (index == nullIndex)
+                    continue;
+                if (index != next)
+                    swapSlots(index, next);
+                next++;
+            }
+        };
+
+        void save(Snapshot& out) const override
+        {
+            if constexpr (!isTag<T> && !std::is_trivially_copyable_v<T>)
+            {
+                if (!m_dense.empty())
+                {
+                    logError("Only trivially copyable components can be saved in a snapshot! Type: {}", typeid(T).name());
+                    throw AlkahestError{};
+                }
+            }
+
+            out.write<uint64_t>(m_dense.size());
+            out.write(m_dense.data(), m_dense.size() * sizeof(ALKAHEST_ENTITY_ID_TYPE));
+            if constexpr (!isTag<T>)
+            {
+                for (size_t p = 0; p < m_componentArray.pageCount(); p++)
+                {
+                    size_t count = std::min(Storage::pageSize, m_dense.size() - p * Storage::pageSize);
+                    out.write(m_componentArray.page(p), count * sizeof(T));
+                }
+            }
+        };
+
+        void load(Snapshot::Reader& in, ALKAHEST_TICK_TYPE tick) override
+        {
+            clear();
+
+            size_t count = in.read<uint64_t>();
+            in.checkCount(count, sizeof(ALKAHEST_ENTITY_ID_TYPE));
+            m_dense.resize(count);
+            in.read(m_dense.data(), count * sizeof(ALKAHEST_ENTITY_ID_TYPE));
+            for (size_t i = 0; i < count; i++)
+                sparseSlot(m_dense[i]) = static_cast<Index>(i);
+
+            if constexpr (!isTag<T> && std::is_trivially_copyable_v<T>)
+            {
+                m_changed.assign(count, tick);
+                m_componentArray.appendBytes(in.skip(count * sizeof(T)), count);
+            }
+            else if constexpr (!isTag<T>)
+            {
+                if (count > 0)
+                {
+                    logError("Only trivially copyable components can be restored from a snapshot! Type: {}", typeid(T).name());
+                    throw AlkahestError{};
+                }
+            }
+        };
+
+        // Sparse pages are kept around, since a restore usually refills
+        // the same range of entity indices
+        void clear() override
+        {
+            for (ALKAHEST_ENTITY_ID_TYPE id : m_dense)
+                sparseSlot(id) = nullIndex;
+            m_dense.clear();
+            m_changed.clear();
+            m_componentArray.clear();
+        };
+
+        std::unique_ptr<BaseComponentArray> makeEmpty() const override
+        {
+            return std::make_unique<ComponentArray<T>>();
+        };
+
+        void swap(BaseComponentArray& other) override
+        {
+            ComponentArray<T>& array = static_cast<ComponentArray<T>&>(other);
+            std::swap(m_sparse, array.m_sparse);
+            m_dense.swap(array.m_dense);
+            m_changed.swap(array.m_changed);
+            m_componentArray.swap(array.m_componentArray);
+        };
+    private:
+        // The dense ID is compared as well so a stale ID whose index has
+        // been recycled doesn't resolve to the new entity's component
+        Index indexOf(ALKAHEST_ENTITY_ID_TYPE id) const
+        {
+            Index index = m_sparse.get(id);
+            return index != nullIndex && m_dense[index] == id ? index : nullIndex;
+        };
+
+        Index& sparseSlot(ALKAHEST_ENTITY_ID_TYPE id)
+        {
+            return m_sparse.slot(id);
+        };
+
+        void swapSlots(Index a, Index b)
+        {
+            std::swap(m_dense[a], m_dense[b]);
+            sparseSlot(m_dense[a]) = a;
+            sparseSlot(m_dense[b]) = b;
+            if constexpr (!isTag<T>)
+            {
+                std::swap(m_componentArray[a], m_componentArray[b]);
+                std::swap(m_changed[a], m_changed[b]);
+            }
         };
     private:
-        std::array<T, ALKAHEST_ENTITY_LIMIT> m_componentArray{};
-        std::unordered_map<ALKAHEST_ENTITY_ID_TYPE, size_t> m_mEntityToIndex{};
-        std::unordered_map<size_t, ALKAHEST_ENTITY_ID_TYPE> m_mIndexToEntity{};
-        size_t m_size{};
+        SparseIndex m_sparse{};
+        std::vector<ALKAHEST_ENTITY_ID_TYPE> m_dense{};
+        std::vector<ALKAHEST_TICK_TYPE> m_changed{};
+        Storage m_componentArray{};
     };
 
     class NOT_EXPORTED ComponentManager
@@ -77,80 +359,299 @@ namespace Alkahest
         template<typename T>
         void registerComponent()
         {
-            const char* typeName = typeid(T).name();
+            size_t type = TypeIndex<Component>::assign<T>();
 
-            if (std::find(m_componentTypes.begin(), m_componentTypes.end(), typeName)
-                    != m_componentTypes.end())
+            if (type >= ALKAHEST_COMPONENT_LIMIT)
             {
-                logError("Component Type has already been registered! Type: {}", typeName);
+                logError("Component limit reached! Type: {}", typeid(T).name());
                 throw AlkahestError{};
             }
 
-            m_componentTypes.push_back(typeName);
-            m_componentArrays.insert({ typeName, std::make_shared<ComponentArray<T>>() });
+            if (m_registered.test(type))
+            {
+                logError("Component Type has already been registered! Type: {}", typeid(T).name());
+                throw AlkahestError{};
+            }
+
+            m_registered.set(type);
+            if (m_infos.size() <= type)
+                m_infos.resize(type + 1);
+            m_infos[type] = ComponentInfo::of<T>();
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+            m_archetypes.registerType(static_cast<ALKAHEST_COMPONENT_ID_TYPE>(type), m_infos[type]);
+#else
+            m_componentArrays[type] = std::make_unique<ComponentArray<T>>();
+#endif
+        };
+
+        // Starts a new change tick and returns it. Every change made after
+        // this call is stamped with the returned tick or a later one.
+        ALKAHEST_TICK_TYPE advanceTick()
+        {
+            return m_tick.fetch_add(1, std::memory_order_relaxed) + 1;
+        };
+
+        ALKAHEST_TICK_TYPE getTick() const
+        {
+            return m_tick.load(std::memory_order_relaxed);
+        };
+
+        bool isRegistered(ALKAHEST_MASK_TYPE mask) const
+        {
+            return m_registered.contains(mask);
         };
 
         template<typename T>
         ALKAHEST_COMPONENT_ID_TYPE getComponentType()
         {
-            const char* typeName = typeid(T).name();
-            std::vector<const char*>::iterator i =
-                std::find(m_componentTypes.begin(), m_componentTypes.end(), typeName);
-            if (i == m_componentTypes.end())
+            size_t type = TypeIndex<Component>::get<T>();
+            if (type >= ALKAHEST_COMPONENT_LIMIT || !m_registered.test(type))
             {
-                logError("Component not registered before use!");
+                logError("Component not registered before use! Component Type: {}", typeid(T).name());
                 throw AlkahestError{};
             }
-            return static_cast<uint8_t>(std::distance(m_componentTypes.begin(), i));
+            return static_cast<ALKAHEST_COMPONENT_ID_TYPE>(type);
+        };
+
+        // Writes a table describing every registered type, followed by the
+        // contents of the component storage
+        void save(Snapshot& out) const
+        {
+            out.write(static_cast<uint32_t>(m_registered.count()));
+            m_registered.forEach([&](size_t type) {
+                const ComponentInfo& info = m_infos[type];
+                out.write(static_cast<ALKAHEST_COMPONENT_ID_TYPE>(type));
+                out.write(info.version);
+                out.write(static_cast<uint64_t>(info.size));
+                out.writeString(info.name);
+            });
+
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+            m_archetypes.save(out);
+#else
+            m_registered.forEach([&](size_t type) {
+                m_componentArrays[type]->save(out);
+            });
+#endif
+        };
+
+        // Component storage read from a snapshot by load(), which only
+        // replaces the live storage once restore() is called
+        struct Loaded
+        {
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+            ArchetypeStorage archetypes{};
+#else
+            std::array<std::unique_ptr<BaseComponentArray>, ALKAHEST_COMPONENT_LIMIT> componentArrays{};
+#endif
+        };
+
+        // Reads the components written by save() into separate storage.
+        // The type table is checked before any data is read, and nothing
+        // in use is touched, so a rejected snapshot leaves the components
+        // as they were.
+        Loaded load(Snapshot::Reader& in) const
+        {
+            ALKAHEST_MASK_TYPE saved{};
+            uint32_t typeCount = in.read<uint32_t>();
+            for (uint32_t i = 0; i < typeCount; i++)
+            {
+                size_t type = in.read<ALKAHEST_COMPONENT_ID_TYPE>();
+                uint32_t version = in.read<uint32_t>();
+                uint64_t size = in.read<uint64_t>();
+                std::string name = in.readString();
+
+                if (type >= ALKAHEST_COMPONENT_LIMIT || !m_registered.test(type)
+                    || m_infos[type].name != name || m_infos[type].size != size)
+                {
+                    logError("Snapshot component type does not match the registered types! Type: {}", name);
+                    throw AlkahestError{};
+                }
+                if (m_infos[type].version != version)
+                {
+                    logError("Snapshot component version is out of date! Type: {} Version: {}", name, version);
+                    throw AlkahestError{};
+                }
+                saved.set(type);
+            }
+
+            // Stamped with the tick restore() starts
+            ALKAHEST_TICK_TYPE tick = getTick() + 1;
+
+            Loaded loaded;
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+            m_registered.forEach([&](size_t type) {
+                loaded.archetypes.registerType(static_cast<ALKAHEST_COMPONENT_ID_TYPE>(type), m_infos[type]);
+            });
+            loaded.archetypes.load(in, tick, saved);
+#else
+            m_registered.forEach([&](size_t type) {
+                loaded.componentArrays[type] = m_componentArrays[type]->makeEmpty();
+                if (saved.test(type))
+                    loaded.componentArrays[type]->load(in, tick);
+            });
+#endif
+            return loaded;
         };
 
+        // Replaces every stored component with those read by load(), all
+        // of which are stamped as changed
+        void restore(Loaded loaded)
+        {
+            advanceTick();
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+            m_archetypes = std::move(loaded.archetypes);
+#else
+            // Swapped rather than replaced, so the live arrays keep their
+            // addresses
+            m_registered.forEach([&](size_t type) {
+                m_componentArrays[type]->swap(*loaded.componentArrays[type]);
+            });
+#endif
+        };
+
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
         template<typename T>
         void addComponentToEntity(Entity e, T component)
         {
-            getComponentArray<T>()->insertData(e, component);
+            m_archetypes.insertData(e, getComponentType<T>(), component, getTick());
         };
 
         template<typename T>
         T& getComponent(Entity e)
         {
-            return getComponentArray<T>()->getData(e);
+            T& data = readComponent<T>(e);
+            if constexpr (!isTag<T>)
+                *m_archetypes.getTick(e, getComponentType<T>()) = getTick();
+            return data;
+        };
+
+        template<typename T>
+        T& readComponent(Entity e)
+        {
+            if constexpr (isTag<T>)
+            {
+                if (!m_archetypes.has(e, getComponentType<T>()))
+                {
+                    logError("Attempting to retrieve non-existent component!");
+                    throw AlkahestError{};
+                }
+                return tagInstance<T>();
+            }
+
+            void* data = m_archetypes.getData(e, getComponentType<T>());
+            if (data == nullptr)
+            {
+                logError("Attempting to retrieve non-existent component!");
+                throw AlkahestError{};
+            }
+            return *static_cast<T*>(data);
         };
 
         template<typename T>
         void removeComponentFromEntity(Entity e)
         {
-            getComponentArray<T>()->removeData(e);
+            m_archetypes.removeData(e, getComponentType<T>());
         };
 
-        void EntityDestroyed(Entity e)
+        // The entity's archetype already knows its components
+        void EntityDestroyed(Entity e, ALKAHEST_MASK_TYPE)
         {
-            for (auto const& pair : m_componentArrays)
-            {
-                auto const& cArr = pair.second;
-                cArr->EntityDestroyed(e);
-            }
+            m_archetypes.EntityDestroyed(e);
         };
-    private:
-        // Convenience function to get the array for a given type
+
+        // Gives entities without any components a copy of every component
+        // in the prefab, placing them straight into the final archetype
+        void insertBatch(const Prefab& prefab, const Entity* entities, size_t count)
+        {
+            std::array<const void*, ALKAHEST_COMPONENT_LIMIT> values{};
+            for (size_t type = 0; type < ALKAHEST_COMPONENT_LIMIT; type++)
+                values[type] = prefab.data(type);
+
+            m_archetypes.insertBatch(entities, count, prefab.getMask(), values, getTick());
+        };
+
+        // Components of an entity already share a row, so sorting each
+        // archetype by T keeps every other type in the same order
+        template<typename T, typename... Us, typename Compare>
+        void sort(Compare compare)
+        {
+            static_assert(!isTag<T>, "Tags have no data to sort by");
+            (getComponentType<Us>(), ...);
+
+            m_archetypes.sort(getComponentType<T>(), [&](const void* a, const void* b) {
+                return compare(*static_cast<const T*>(a), *static_cast<const T*>(b));
+            });
+        };
+
+        ArchetypeStorage& getArchetypeStorage() { return m_archetypes; };
+#else
         template<typename T>
-        std::shared_ptr<ComponentArray<T>> getComponentArray()
+        void addComponentToEntity(Entity e, T component)
         {
-            const char* typeName = typeid(T).name();
+            getComponentArray<T>()->insertData(e, component, getTick());
+        };
 
-            if (std::find(m_componentTypes.begin(), m_componentTypes.end(), typeName)
-                    == m_componentTypes.end())
-            {
-                logError("Component not registered before use! Component Type: {}", typeName);
-                throw AlkahestError{};
-            }
+        template<typename T>
+        T& getComponent(Entity e)
+        {
+            return getComponentArray<T>()->getData(e, getTick());
+        };
 
-            logTrace("Found ComponentArray for {}", typeName);
-            return std::static_pointer_cast<ComponentArray<T>>(m_componentArrays[typeName]);
+        template<typename T>
+        T& readComponent(Entity e)
+        {
+            return getComponentArray<T>()->readData(e);
+        };
+
+        template<typename T>
+        void removeComponentFromEntity(Entity e)
+        {
+            getComponentArray<T>()->removeData(e);
+        };
+
+        // Only the arrays named in the entity's mask can hold it
+        void EntityDestroyed(Entity e, ALKAHEST_MASK_TYPE mask)
+        {
+            mask.forEach([&](size_t type) {
+                m_componentArrays[type]->EntityDestroyed(e);
+            });
+        };
+
+        // Gives entities without any components a copy of every component
+        // in the prefab, filling each component array in a single pass
+        void insertBatch(const Prefab& prefab, const Entity* entities, size_t count)
+        {
+            prefab.getMask().forEach([&](size_t type) {
+                m_componentArrays[type]->insertBatch(entities, count, prefab.data(type), getTick());
+            });
+        };
+
+        // Sorts T's array, then moves the entities that also have one of Us
+        // to the front of that type's array in the same order
+        template<typename T, typename... Us, typename Compare>
+        void sort(Compare compare)
+        {
+            ComponentArray<T>* array = getComponentArray<T>();
+            array->sort(compare);
+            (getComponentArray<Us>()->arrange(array->entities(), array->size()), ...);
+        };
+
+        // Convenience function to get the array for a given type
+        template<typename T>
+        ComponentArray<T>* getComponentArray()
+        {
+            return static_cast<ComponentArray<T>*>(m_componentArrays[getComponentType<T>()].get());
         };
+#endif
     private:
-        std::vector<const char*> m_componentTypes{};
-        //std::unordered_map<const char*, ALKAHEST_COMPONENT_ID_TYPE> m_componentTypes{};
-        std::unordered_map<const char*, std::shared_ptr<BaseComponentArray>> m_componentArrays{};
-        ALKAHEST_COMPONENT_ID_TYPE m_nextComponentType{};
+        ALKAHEST_MASK_TYPE m_registered{};
+        std::vector<ComponentInfo> m_infos{};
+        std::atomic<ALKAHEST_TICK_TYPE> m_tick{ 1 };
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+        ArchetypeStorage m_archetypes{};
+#else
+        std::array<std::unique_ptr<BaseComponentArray>, ALKAHEST_COMPONENT_LIMIT> m_componentArrays{};
+#endif
     };
 }
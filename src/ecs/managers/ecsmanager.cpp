@@ -2,6 +2,42 @@
 
 namespace Alkahest
 {
+    World& ECSManager::getDefaultWorld()
+    {
+        static World world;
+        return world;
+    }
+
+    World*& World::currentSlot()
+    {
+        static thread_local World* current = nullptr;
+        return current;
+    }
+
+    uint64_t World::nextID()
+    {
+        static std::atomic<uint64_t> next{ 1 };
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t TypeRegistry::find(const char* family, const char* type, bool assign)
+    {
+        static std::mutex mutex;
+        static std::unordered_map<std::string, std::unordered_map<std::string, size_t>> families;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<std::string, size_t>& indices = families[family];
+        auto found = indices.find(type);
+        if (found != indices.end())
+            return found->second;
+        if (!assign)
+            return null;
+
+        size_t index = indices.size();
+        indices.emplace(type, index);
+        return index;
+    }
+
     Entity Entity::create()
     {
         return ECSManager::createEntity();
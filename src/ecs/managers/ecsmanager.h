@@ -2,139 +2,126 @@
 
 #include "../../macros.h"
 #include "../common.h"
-#include "entitymanager.h"
-#include "componentmanager.h"
-#include "systemmanager.h"
-#include "../entity.h"
-
-// Engine Components and Systems
-#include "../components/include.h"
-#include "../systems/include.h"
+#include "../world.h"
 
 namespace Alkahest
 {
+    // Static access to the calling thread's current World, so code that
+    // only ever deals with one world doesn't have to pass it around. The
+    // current world is the default world unless a World::Scope is active,
+    // and systems always run with their own world as the current one.
     class NOT_EXPORTED ECSManager
     {
     public:
-        // registerComponent and registerSystem are defined here
-        // so the can be used in the init function with no issues
-        template<typename T>
-        void registerComponentImpl()
-        {
-            m_componentManager->registerComponent<T>();
-        }
-
-        template<typename T>
-        void registerSystemImpl()
+        // The world the static functions act on from this thread
+        static World& getWorld()
         {
-            m_systemManager->registerSystem<T>();
-        }
-
-        void initImpl()
-        {
-            m_entityManager = std::make_unique<EntityManager>();
-            m_componentManager = std::make_unique<ComponentManager>();
-            m_systemManager = std::make_unique<SystemManager>();
-
-            // Register all engine-defined components and systems
-            registerComponentImpl<Components::TransformComponent>();
+            World* world = World::current();
+            return world != nullptr ? *world : getDefaultWorld();
         };
 
-        Entity createEntityImpl()
-        {
-            return m_entityManager->createEntity();
-        };
+        // Created, with the engine components and systems registered, on
+        // first use. Defined in ecsmanager.cpp, so the engine and the
+        // client always share one default world.
+        static API World& getDefaultWorld();
 
-        void destroyEntityImpl(Entity e)
-        {
-            m_entityManager->destroyEntity(e);
-            m_componentManager->EntityDestroyed(e);
-            m_systemManager->EntityDestroyed(e);
-        };
+        static void init() { getDefaultWorld(); };
+        static Entity createEntity() { return getWorld().createEntity(); };
+        static void destroyEntity(Entity e) { getWorld().destroyEntity(e); };
+        static void update() { getWorld().update(); };
+        static bool isAlive(Entity e) { return getWorld().isAlive(e); };
 
-        template<typename T>
-        void addComponentToEntityImpl(Entity e, T component)
-        {
-            m_componentManager->addComponentToEntity(e, component);
-            
-            ALKAHEST_MASK_TYPE mask = m_entityManager->getMask(e);
-            mask |= BIT(m_componentManager->getComponentType<T>());
-            m_entityManager->setMask(e, mask);
+        // Creates `count` entities that all start out with a copy of the
+        // prefab's components
+        static std::vector<Entity> spawnBatch(const Prefab& prefab, size_t count)
+            { return getWorld().spawnBatch(prefab, count); };
+        static CommandBuffer& commands() { return getWorld().commands(); };
+        static void flushCommands() { getWorld().flushCommands(); };
 
-            m_systemManager->EntityMaskChanged(e, mask);
-        };
+        // Batched notifications of T being added to, removed from or
+        // changed on entities, delivered at the end of update()
+        template<typename T>
+        static void onAdd(ObserverCallback fn) { getWorld().onAdd<T>(std::move(fn)); };
 
         template<typename T>
-        void removeComponentFromEntityImpl(Entity e)
-        {
-            m_componentManager->removeComponentFromEntity<T>(e);
+        static void onRemove(ObserverCallback fn) { getWorld().onRemove<T>(std::move(fn)); };
 
-            ALKAHEST_MASK_TYPE mask = m_entityManager->getMask(e);
-            ALKAHEST_COMPONENT_ID_TYPE componentID = m_componentManager->
-                getComponentType<T>();
-            mask |= BIT(componentID);
-            mask ^= BIT(componentID);
-            m_entityManager->setMask(e, mask);
+        template<typename T>
+        static void onChange(ObserverCallback fn) { getWorld().onChange<T>(std::move(fn)); };
+        static void flushObservers() { getWorld().flushObservers(); };
 
-            m_systemManager->EntityMaskChanged(e, mask);
-        };
+        // Sorts T's storage and keeps each of Us in the same order, e.g.
+        //     ECSManager::sort<MeshComponent, TransformComponent>(byMaterial);
+        template<typename T, typename... Us, typename Compare>
+        static void sort(Compare compare) { getWorld().sort<T, Us...>(compare); };
 
-        template<typename T>
-        T& getComponentImpl(Entity e)
-        {
-            return m_componentManager->getComponent<T>(e);
-        };
+        // Starts a new change tick and returns it. Passing the result to
+        // View::changed() later yields the components changed since this
+        // call, e.g. for a renderer uploading only what moved.
+        static ALKAHEST_TICK_TYPE advanceTick() { return getWorld().advanceTick(); };
+        static ALKAHEST_TICK_TYPE getTick() { return getWorld().getTick(); };
 
-        template<typename T>
-        ALKAHEST_COMPONENT_ID_TYPE getComponentTypeImpl()
-        {
-            return m_componentManager->getComponentType<T>();
-        };
+        static Snapshot snapshot() { return getWorld().snapshot(); };
+        static void restore(const Snapshot& snapshot) { getWorld().restore(snapshot); };
 
         template<typename T>
-        void setSystemMaskImpl(ALKAHEST_MASK_TYPE mask)
-        {
-            m_systemManager->setMask<T>(mask);
-        };
-    private:
-        static ECSManager& getInstance()
-        {
-            static ECSManager m;
-            std::cout << "ECSManager& address: " << &m << std::endl;
-            return m;
-        }
-    public: 
-        static void init() { getInstance().initImpl(); };
-        static Entity createEntity() { return getInstance().createEntityImpl(); };
-        static void destroyEntity(Entity e) { getInstance().destroyEntityImpl(e); };
-    public:
-        template<typename T>
-        static void registerComponent() { getInstance().registerComponentImpl<T>(); };
+        static void registerComponent() { getWorld().registerComponent<T>(); };
         
         template<typename T>
-        static void registerSystem() { getInstance().registerSystemImpl<T>(); };
+        static void registerSystem() { getWorld().registerSystem<T>(); };
 
         template<typename T>
         static void addComponentToEntity(Entity e, T component)
-            { getInstance().addComponentToEntityImpl(e, component); };
+            { getWorld().addComponent(e, component); };
 
         template<typename T>
         static void removeComponentFromEntity(Entity e)
-            { getInstance().removeComponentFromEntityImpl<T>(e); };
+            { getWorld().removeComponent<T>(e); };
         
+        // Mutable access, which stamps the component as changed
+        template<typename T>
+        static T& getComponent(Entity e) { return getWorld().getComponent<T>(e); };
+
+        // Read-only access, which leaves the change tick alone
+        template<typename T>
+        static const T& readComponent(Entity e) { return getWorld().readComponent<T>(e); };
+
+        // Singleton components hold global state (settings, input, the
+        // active camera) once instead of on an entity
         template<typename T>
-        static T& getComponent(Entity e) { return getInstance().getComponentImpl<T>(e); };
+        static void setSingleton(T value) { getWorld().setSingleton(std::move(value)); };
+
+        template<typename T>
+        static T& getSingleton() { return getWorld().getSingleton<T>(); };
+
+        template<typename T>
+        static T* tryGetSingleton() { return getWorld().tryGetSingleton<T>(); };
+
+        template<typename T>
+        static void removeSingleton() { getWorld().removeSingleton<T>(); };
 
         template<typename T>
         static ALKAHEST_COMPONENT_ID_TYPE getComponentType()
-            { return getInstance().getComponentTypeImpl<T>(); };
+            { return getWorld().getComponentType<T>(); };
         
         template<typename T>
-        static void setSystemMask(ALKAHEST_MASK_TYPE mask) { getInstance().setSystemMaskImpl<T>(mask); };
-    private:
-        std::unique_ptr<EntityManager> m_entityManager;
-        std::unique_ptr<ComponentManager> m_componentManager;
-        std::unique_ptr<SystemManager> m_systemManager;
+        static void setSystemMask(ALKAHEST_MASK_TYPE mask, ALKAHEST_MASK_TYPE excluded = {})
+            { getWorld().setSystemMask<T>(mask, excluded); };
+
+        template<typename T>
+        static std::shared_ptr<T> getSystem() { return getWorld().getSystem<T>(); };
+
+        template<typename T>
+        static void setSystemAccess(ALKAHEST_MASK_TYPE reads, ALKAHEST_MASK_TYPE writes)
+            { getWorld().setSystemAccess<T>(reads, writes); };
+
+        // Builds a mask from a list of component types
+        template<typename... Cs>
+        static ALKAHEST_MASK_TYPE getComponentMask()
+            { return getWorld().getComponentMask<Cs...>(); };
+
+        template<typename... Ts>
+        static View<Ts...> view() { return getWorld().view<Ts...>(); };
     };
 
     template<typename T>
@@ -149,6 +136,12 @@ namespace Alkahest
         return ECSManager::getComponent<T>(*this);
     }
 
+    template<typename T>
+    const T& Entity::readComponent()
+    {
+        return ECSManager::readComponent<T>(*this);
+    }
+
     template<typename T>
     void Entity::removeComponent()
     {
@@ -173,9 +166,24 @@ namespace Alkahest
         }
 
         template<typename T>
-        void setMask(ALKAHEST_MASK_TYPE mask)
+        void setMask(ALKAHEST_MASK_TYPE mask, ALKAHEST_MASK_TYPE excluded = {})
+        {
+            ECSManager::setSystemMask<T>(mask, excluded);
+        }
+
+        // Declares the component types a system reads and writes, e.g.
+        //     Systems::setAccess<Movement>(
+        //         Systems::access<Velocity>(), Systems::access<TransformComponent>());
+        template<typename T>
+        void setAccess(ALKAHEST_MASK_TYPE reads, ALKAHEST_MASK_TYPE writes)
+        {
+            ECSManager::setSystemAccess<T>(reads, writes);
+        }
+
+        template<typename... Cs>
+        ALKAHEST_MASK_TYPE access()
         {
-            ECSManager::setSystemMask<T>(mask);
+            return ECSManager::getComponentMask<Cs...>();
         }
     }
 }
@@ -3,49 +3,266 @@
 #include "../../macros.h"
 #include "../common.h"
 #include "../entity.h"
+#include "../snapshot.h"
+#include "../../sys/log/log.h"
 
 namespace Alkahest
 {
+    // Tracks live entities and their component masks. Per-entity data is
+    // kept in dense arrays indexed by the entity index, and released
+    // indices go on a free list so creating and destroying are both O(1).
     class NOT_EXPORTED EntityManager
     {
     public:
-        EntityManager()
+        EntityManager() {};
+        ~EntityManager() {};
+
+        Entity createEntity()
         {
-            m_liveEntityCount = 0;
+            commitReserved();
 
-            for (ALKAHEST_ENTITY_ID_TYPE i = 0; i < ALKAHEST_ENTITY_LIMIT; i++)
+            ALKAHEST_ENTITY_ID_TYPE index;
+            if (!m_freeList.empty())
             {
-                m_availableEntities.push(i);
+                index = m_freeList.back();
+                m_freeList.pop_back();
+            }
+            else
+            {
+                // Only grow the index space once every released index is reused
+                if (m_generations.size() >= ALKAHEST_ENTITY_LIMIT)
+                {
+                    logError("Entity limit reached! Limit: {}", ALKAHEST_ENTITY_LIMIT);
+                    throw AlkahestError{};
+                }
+                index = static_cast<ALKAHEST_ENTITY_ID_TYPE>(m_generations.size());
+                m_generations.push_back(0);
+                m_signatures.push_back({});
             }
-        };
-        ~EntityManager() {};
 
-        Entity createEntity()
-        {
-            ALKAHEST_ENTITY_ID_TYPE id = m_availableEntities.front();
-            m_availableEntities.pop();
-            Entity e(id, 0);
+            Entity e((m_generations[index] << ALKAHEST_ENTITY_INDEX_BITS) | index);
             m_liveEntityCount++;
 
             return e;
         };
 
+        // Creates `count` entities at once and appends them to `out`.
+        // Released indices are reused first and the index space is grown
+        // once for the rest.
+        void createEntities(size_t count, std::vector<Entity>& out)
+        {
+            commitReserved();
+
+            size_t reused = std::min(count, m_freeList.size());
+            size_t fresh = count - reused;
+            if (m_generations.size() + fresh > ALKAHEST_ENTITY_LIMIT)
+            {
+                logError("Entity limit reached! Limit: {}", ALKAHEST_ENTITY_LIMIT);
+                throw AlkahestError{};
+            }
+
+            out.reserve(out.size() + count);
+            for (size_t i = 0; i < reused; i++)
+            {
+                ALKAHEST_ENTITY_ID_TYPE index = m_freeList.back();
+                m_freeList.pop_back();
+                out.push_back(Entity((m_generations[index] << ALKAHEST_ENTITY_INDEX_BITS) | index));
+            }
+
+            size_t first = m_generations.size();
+            m_generations.resize(first + fresh, 0);
+            m_signatures.resize(first + fresh);
+            for (size_t i = 0; i < fresh; i++)
+                out.push_back(Entity(static_cast<ALKAHEST_ENTITY_ID_TYPE>(first + i)));
+
+            m_liveEntityCount += static_cast<ALKAHEST_ENTITY_ID_TYPE>(count);
+        };
+
+        // Hands out entities while other threads may be reading the entity
+        // arrays, e.g. from a command buffer while systems run. Released
+        // indices are reused right away. Fresh indices are numbered past
+        // the end of the arrays, which only grow on commitReserved(), so
+        // the arrays are never reallocated under a reader. Entities with a
+        // fresh index aren't alive until then. Calls must not overlap.
+        void reserveEntities(size_t count, std::vector<Entity>& out)
+        {
+            size_t reused = std::min(count, m_freeList.size());
+            size_t fresh = count - reused;
+            size_t first = m_generations.size() + m_reservedFresh;
+            if (first + fresh > ALKAHEST_ENTITY_LIMIT)
+            {
+                logError("Entity limit reached! Limit: {}", ALKAHEST_ENTITY_LIMIT);
+                throw AlkahestError{};
+            }
+
+            out.reserve(out.size() + count);
+            for (size_t i = 0; i < reused; i++)
+            {
+                ALKAHEST_ENTITY_ID_TYPE index = m_freeList.back();
+                m_freeList.pop_back();
+                out.push_back(Entity((m_generations[index] << ALKAHEST_ENTITY_INDEX_BITS) | index));
+            }
+            for (size_t i = 0; i < fresh; i++)
+                out.push_back(Entity(static_cast<ALKAHEST_ENTITY_ID_TYPE>(first + i)));
+
+            m_reservedFresh += fresh;
+            m_reservedCount += count;
+        };
+
+        // Grows the arrays over every fresh index reserved so far. Must
+        // only be called while nothing else uses the EntityManager.
+        void commitReserved()
+        {
+            if (m_reservedCount == 0)
+                return;
+
+            m_generations.resize(m_generations.size() + m_reservedFresh, 0);
+            m_signatures.resize(m_generations.size());
+            m_liveEntityCount += static_cast<ALKAHEST_ENTITY_ID_TYPE>(m_reservedCount);
+            m_reservedFresh = 0;
+            m_reservedCount = 0;
+        };
+
         void destroyEntity(Entity e)
         {
-            m_availableEntities.push(e.ID);
+            ALKAHEST_ENTITY_ID_TYPE index = entityIndex(e.ID);
+
+            // Bumping the generation invalidates every copy of this ID
+            m_generations[index] = (m_generations[index] + 1) & maxGeneration;
+            m_signatures[index] = {};
+            m_freeList.push_back(index);
             m_liveEntityCount--;
         };
 
-        ALKAHEST_MASK_TYPE getMask(Entity e)
+        bool isAlive(Entity e) const
+        {
+            ALKAHEST_ENTITY_ID_TYPE index = entityIndex(e.ID);
+            return index < m_generations.size() && m_generations[index] == entityGeneration(e.ID);
+        };
+
+        ALKAHEST_MASK_TYPE getMask(Entity e) const
         {
-            return e.Mask;
+            return m_signatures[entityIndex(e.ID)];
         };
+
         void setMask(Entity e, ALKAHEST_MASK_TYPE mask)
         {
-            e.Mask = mask;
-        }
+            m_signatures[entityIndex(e.ID)] = mask;
+        };
+
+        ALKAHEST_ENTITY_ID_TYPE getLiveEntityCount() const { return m_liveEntityCount; };
+
+        // Calls fn(Entity, mask) for every live entity that has at least
+        // one component
+        template<typename Fn>
+        void forEachWithMask(Fn&& fn) const
+        {
+            for (size_t index = 0; index < m_signatures.size(); index++)
+            {
+                if (m_signatures[index].none())
+                    continue;
+
+                ALKAHEST_ENTITY_ID_TYPE i = static_cast<ALKAHEST_ENTITY_ID_TYPE>(index);
+                fn(Entity((m_generations[index] << ALKAHEST_ENTITY_INDEX_BITS) | i), m_signatures[index]);
+            }
+        };
+
+        // Writes the generations, masks and free list as contiguous blocks
+        void save(Snapshot& out) const
+        {
+            out.write<uint64_t>(m_generations.size());
+            out.write(m_generations.data(), sizeof(ALKAHEST_ENTITY_ID_TYPE) * m_generations.size());
+            out.write(m_signatures.data(), sizeof(ALKAHEST_MASK_TYPE) * m_signatures.size());
+            out.write<uint64_t>(m_freeList.size());
+            out.write(m_freeList.data(), sizeof(ALKAHEST_ENTITY_ID_TYPE) * m_freeList.size());
+            out.write(m_liveEntityCount);
+        };
+
+        // Entity state read from a snapshot by load(), which only
+        // replaces the live state once restore() is called
+        struct Loaded
+        {
+            std::vector<ALKAHEST_ENTITY_ID_TYPE> generations;
+            std::vector<ALKAHEST_MASK_TYPE> signatures;
+            std::vector<ALKAHEST_ENTITY_ID_TYPE> freeList;
+            ALKAHEST_ENTITY_ID_TYPE liveEntityCount;
+        };
+
+        // Everything is checked up front, since a corrupt free list or
+        // generation would otherwise only fail on a later createEntity()
+        Loaded load(Snapshot::Reader& in) const
+        {
+            size_t count = in.read<uint64_t>();
+            if (count > ALKAHEST_ENTITY_LIMIT)
+            {
+                logError("Snapshot exceeds the entity limit! Limit: {}", ALKAHEST_ENTITY_LIMIT);
+                throw AlkahestError{};
+            }
+            std::vector<ALKAHEST_ENTITY_ID_TYPE> generations(count);
+            in.read(generations.data(), sizeof(ALKAHEST_ENTITY_ID_TYPE) * count);
+            std::vector<ALKAHEST_MASK_TYPE> signatures(count);
+            in.read(signatures.data(), sizeof(ALKAHEST_MASK_TYPE) * count);
+
+            for (ALKAHEST_ENTITY_ID_TYPE generation : generations)
+            {
+                if (generation > maxGeneration)
+                {
+                    logError("Snapshot contains an invalid entity generation! Generation: {}", generation);
+                    throw AlkahestError{};
+                }
+            }
+
+            size_t freeCount = in.read<uint64_t>();
+            if (freeCount > count)
+            {
+                logError("Snapshot free list is larger than its entity count! Free: {} Count: {}", freeCount, count);
+                throw AlkahestError{};
+            }
+            std::vector<ALKAHEST_ENTITY_ID_TYPE> freeList(freeCount);
+            in.read(freeList.data(), sizeof(ALKAHEST_ENTITY_ID_TYPE) * freeCount);
+
+            // Free indices must be in range, listed once, and belong to
+            // entities without components
+            std::vector<bool> listed(count, false);
+            for (ALKAHEST_ENTITY_ID_TYPE index : freeList)
+            {
+                if (index >= count || listed[index] || signatures[index].any())
+                {
+                    logError("Snapshot free list contains an invalid entity index! Index: {}", index);
+                    throw AlkahestError{};
+                }
+                listed[index] = true;
+            }
+
+            ALKAHEST_ENTITY_ID_TYPE liveEntityCount = in.read<ALKAHEST_ENTITY_ID_TYPE>();
+            if (liveEntityCount != count - freeCount)
+            {
+                logError("Snapshot live entity count does not match its free list! Live: {} Expected: {}",
+                    liveEntityCount, count - freeCount);
+                throw AlkahestError{};
+            }
+
+            return { std::move(generations), std::move(signatures), std::move(freeList), liveEntityCount };
+        };
+
+        void restore(Loaded loaded)
+        {
+            m_generations = std::move(loaded.generations);
+            m_signatures = std::move(loaded.signatures);
+            m_freeList = std::move(loaded.freeList);
+            m_liveEntityCount = loaded.liveEntityCount;
+            m_reservedFresh = 0;
+            m_reservedCount = 0;
+        };
     private:
+        static constexpr ALKAHEST_ENTITY_ID_TYPE maxGeneration =
+            std::numeric_limits<ALKAHEST_ENTITY_ID_TYPE>::max() >> ALKAHEST_ENTITY_INDEX_BITS;
+
         ALKAHEST_ENTITY_ID_TYPE m_liveEntityCount{};
-        std::queue<ALKAHEST_ENTITY_ID_TYPE> m_availableEntities{};
+        size_t m_reservedFresh{};
+        size_t m_reservedCount{};
+        std::vector<ALKAHEST_ENTITY_ID_TYPE> m_generations{};
+        std::vector<ALKAHEST_MASK_TYPE> m_signatures{};
+        std::vector<ALKAHEST_ENTITY_ID_TYPE> m_freeList{};
     };
 }
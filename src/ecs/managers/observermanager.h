@@ -0,0 +1,151 @@
+#pragma once
+
+#include "../../macros.h"
+#include "../common.h"
+#include "../entity.h"
+#include "entitymanager.h"
+
+namespace Alkahest
+{
+    // Receives every entity of one batch at once
+    using ObserverCallback = std::function<void(const std::vector<Entity>&)>;
+
+    // Appends the entities whose component changed at or after a tick
+    using ChangeCollector = std::function<void(ALKAHEST_TICK_TYPE since, std::vector<Entity>& out)>;
+
+    // Collects the entities whose observed components were added or
+    // removed as entity masks change, and hands them to the callbacks
+    // registered for each component type in one batch per flush instead
+    // of one call per change. Changes are found with the change ticks
+    // when flushing, so they cost nothing to record. Changes to types
+    // nobody observes cost a single mask test.
+    class NOT_EXPORTED ObserverManager
+    {
+    public:
+        explicit ObserverManager(const EntityManager& entityManager) : m_entityManager(entityManager) {};
+
+        void onAdd(ALKAHEST_COMPONENT_ID_TYPE type, ObserverCallback fn)
+        {
+            m_observers[type].onAdd.push_back(std::move(fn));
+            m_observed.set(type);
+        };
+
+        void onRemove(ALKAHEST_COMPONENT_ID_TYPE type, ObserverCallback fn)
+        {
+            m_observers[type].onRemove.push_back(std::move(fn));
+            m_observed.set(type);
+        };
+
+        // Only changes made at or after `since` are reported
+        void onChange(ALKAHEST_COMPONENT_ID_TYPE type, ChangeCollector collect,
+            ObserverCallback fn, ALKAHEST_TICK_TYPE since)
+        {
+            Observers& o = m_observers[type];
+            if (o.onChange.empty())
+            {
+                o.collect = std::move(collect);
+                o.since = since;
+            }
+            o.onChange.push_back(std::move(fn));
+            m_changeObserved.set(type);
+        };
+
+        void EntityMaskChanged(Entity e, ALKAHEST_MASK_TYPE oldMask, ALKAHEST_MASK_TYPE newMask)
+        {
+            ALKAHEST_MASK_TYPE changed = (oldMask ^ newMask) & m_observed;
+            if (changed.none())
+                return;
+
+            changed.forEach([&](size_t type) {
+                Observers& o = m_observers[type];
+                (newMask.test(type) ? o.added : o.removed).push_back(e);
+            });
+        };
+
+        void EntitiesCreated(const std::vector<Entity>& entities, ALKAHEST_MASK_TYPE mask)
+        {
+            (mask & m_observed).forEach([&](size_t type) {
+                std::vector<Entity>& added = m_observers[type].added;
+                added.insert(added.end(), entities.begin(), entities.end());
+            });
+        };
+
+        void EntityDestroyed(Entity e, ALKAHEST_MASK_TYPE mask)
+        {
+            EntityMaskChanged(e, mask, {});
+        };
+
+        // Hands each observed type's pending batches to its callbacks:
+        // removals first, then additions of components that still exist,
+        // then changes since the last flush. Callbacks may change the
+        // world, and those changes are delivered on the next flush.
+        void flush(ALKAHEST_TICK_TYPE tick)
+        {
+            (m_observed | m_changeObserved).forEach([&](size_t type) {
+                Observers& o = m_observers[type];
+
+                std::vector<Entity> removed;
+                std::vector<Entity> added;
+                removed.swap(o.removed);
+                added.swap(o.added);
+
+                // An entity only shows up twice in one list if the
+                // component was removed and re-added (or the other way
+                // around) in between
+                if (!removed.empty() && !added.empty())
+                {
+                    unique(removed);
+                    unique(added);
+                }
+
+                added.erase(std::remove_if(added.begin(), added.end(), [&](Entity e) {
+                    return !m_entityManager.isAlive(e) || !m_entityManager.getMask(e).test(type);
+                }), added.end());
+
+                deliver(o.onRemove, removed);
+                deliver(o.onAdd, added);
+
+                if (!o.onChange.empty())
+                {
+                    std::vector<Entity> changed;
+                    o.collect(o.since, changed);
+                    o.since = tick;
+                    deliver(o.onChange, changed);
+                }
+            });
+        };
+    private:
+        struct Observers
+        {
+            std::vector<ObserverCallback> onAdd{};
+            std::vector<ObserverCallback> onRemove{};
+            std::vector<ObserverCallback> onChange{};
+            ChangeCollector collect{};
+            ALKAHEST_TICK_TYPE since{};
+
+            std::vector<Entity> added{};
+            std::vector<Entity> removed{};
+        };
+
+        static void deliver(const std::vector<ObserverCallback>& callbacks, const std::vector<Entity>& entities)
+        {
+            if (entities.empty())
+                return;
+            for (const ObserverCallback& fn : callbacks)
+                fn(entities);
+        };
+
+        static void unique(std::vector<Entity>& entities)
+        {
+            std::sort(entities.begin(), entities.end(), [](Entity a, Entity b) { return a.ID < b.ID; });
+            entities.erase(std::unique(entities.begin(), entities.end(), [](Entity a, Entity b) {
+                return a.ID == b.ID;
+            }), entities.end());
+        };
+    private:
+        const EntityManager& m_entityManager;
+        ALKAHEST_MASK_TYPE m_observed{};
+        ALKAHEST_MASK_TYPE m_changeObserved{};
+        std::array<Observers, ALKAHEST_COMPONENT_LIMIT> m_observers{};
+    };
+}
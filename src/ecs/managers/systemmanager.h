@@ -3,55 +3,278 @@
 #include "../../macros.h"
 #include "../common.h"
 #include "../entity.h"
+#include "../typeid.h"
+#include "../querygroup.h"
+#include "entitymanager.h"
+#include "componentmanager.h"
+#include "../../sys/jobs/jobsystem.h"
 #include "../systems/_base.h"
 
 namespace Alkahest
 {
+    // Forward declare World class
+    class World;
+
     class NOT_EXPORTED SystemManager
     {
     public:
+        SystemManager(World& world, const EntityManager& entityManager, ComponentManager& componentManager)
+            : m_world(world), m_entityManager(entityManager), m_componentManager(componentManager) {};
+
         template<typename T>
         void registerSystem()
         {
-            const char* typeName = typeid(T).name();
+            size_t type = slotFor<T>();
+            if (!m_systems[type])
+                m_order.push_back(type);
+            m_systems[type] = std::make_shared<T>();
+            m_systems[type]->m_world = &m_world;
+            m_systems[type]->m_group = groupFor(m_masks[type], m_excludes[type]);
+            m_scheduleDirty = true;
+        };
+
+        // A system receives every entity whose mask contains all of the
+        // bits in `mask` and none of the bits in `excluded`
+        template<typename T>
+        void setMask(ALKAHEST_MASK_TYPE mask, ALKAHEST_MASK_TYPE excluded)
+        {
+            size_t type = slotFor<T>();
+            m_masks[type] = mask;
+            m_excludes[type] = excluded;
+            if (m_systems[type])
+                m_systems[type]->m_group = groupFor(mask, excluded);
+        };
 
-            auto system = std::make_shared<T>();
-            m_systems.insert({ typeName, system });
+        template<typename T>
+        std::shared_ptr<T> getSystem()
+        {
+            size_t type = TypeIndex<System>::get<T>();
+            if (type >= m_systems.size())
+                return nullptr;
+            return std::static_pointer_cast<T>(m_systems[type]);
         };
 
+        // Declares which component types a system reads and writes so the
+        // scheduler can run it alongside systems it doesn't conflict with.
+        // Systems that declare nothing are run exclusively. Fetching a
+        // component with getComponent() stamps its change tick and counts
+        // as a write.
         template<typename T>
-        void setMask(ALKAHEST_MASK_TYPE mask)
+        void setAccess(ALKAHEST_MASK_TYPE reads, ALKAHEST_MASK_TYPE writes)
+        {
+            size_t type = slotFor<T>();
+            m_reads[type] = reads;
+            m_writes[type] = writes;
+            m_scheduleDirty = true;
+        };
+
+        // Runs every registered system once. Systems are ordered by their
+        // registration with this world, and a system only waits on earlier
+        // systems whose component access conflicts with its own; everything
+        // else runs concurrently on the job system.
+        void update()
         {
-            const char* typeName = typeid(T).name();
+            if (m_scheduleDirty)
+                buildSchedule();
+
+            if (m_schedule.empty())
+                return;
+
+            JobSystem* jobs = JobSystem::getInstance();
+            JobCounter counter;
+
+            for (size_t node = 0; node < m_schedule.size(); node++)
+            {
+                m_schedule[node].pending.store(m_schedule[node].dependencies, std::memory_order_relaxed);
+            }
+            for (size_t node = 0; node < m_schedule.size(); node++)
+            {
+                if (m_schedule[node].dependencies == 0)
+                    jobs->submit([this, node, &counter]{ runScheduled(node, counter); }, &counter);
+            }
 
-            m_masks.insert({ typeName, mask });
+            jobs->wait(counter);
         };
         
-        void EntityDestroyed(Entity e)
+        void EntityDestroyed(Entity e, ALKAHEST_MASK_TYPE mask)
+        {
+            for (auto const& group : m_groups)
+            {
+                if (group->matches(mask))
+                    group->remove(e);
+            }
+        };
+
+        // A batch of entities that were created with the same mask joins
+        // each matching group in one go
+        void EntitiesCreated(const std::vector<Entity>& entities, ALKAHEST_MASK_TYPE mask)
+        {
+            for (auto const& group : m_groups)
+            {
+                if (group->matches(mask))
+                    group->add(entities);
+            }
+        };
+
+        // Only the groups that care about one of the flipped bits are
+        // visited, and each one only changes if the entity's membership
+        // actually changed
+        void EntityMaskChanged(Entity e, ALKAHEST_MASK_TYPE oldMask, ALKAHEST_MASK_TYPE mask)
+        {
+            (oldMask ^ mask).forEach([&](size_t type) {
+                for (QueryGroup* group : m_groupsByComponent[type])
+                    updateMembership(*group, e, oldMask, mask);
+            });
+
+            // Groups without required components also care about an entity
+            // gaining its first or losing its last component
+            if (oldMask.none() != mask.none())
+            {
+                for (QueryGroup* group : m_unfilteredGroups)
+                    updateMembership(*group, e, oldMask, mask);
+            }
+        };
+
+        // Every mask was replaced at once, so each group is refilled from
+        // scratch in a single pass over the entities
+        void WorldRestored()
+        {
+            for (auto const& group : m_groups)
+                group->clear();
+
+            m_entityManager.forEachWithMask([this](Entity e, ALKAHEST_MASK_TYPE mask) {
+                for (auto const& group : m_groups)
+                {
+                    if (group->matches(mask))
+                        group->add(e);
+                }
+            });
+        };
+    private:
+        static void updateMembership(QueryGroup& group, Entity e,
+            ALKAHEST_MASK_TYPE oldMask, ALKAHEST_MASK_TYPE mask)
+        {
+            bool was = group.matches(oldMask);
+            bool is = group.matches(mask);
+            if (was == is)
+                return;
+
+            if (is)
+                group.add(e);
+            else
+                group.remove(e);
+        };
+
+        // Returns the cached group for a mask pair, creating and filling
+        // it from the existing entities the first time it is requested
+        QueryGroup* groupFor(ALKAHEST_MASK_TYPE required, ALKAHEST_MASK_TYPE excluded)
         {
-            for (auto const& pair : m_systems)
+            for (auto const& group : m_groups)
             {
-                auto const& system = pair.second;
-                system->EntityDestroyed(e);
+                if (group->getRequired() == required && group->getExcluded() == excluded)
+                    return group.get();
             }
+
+            auto group = std::make_unique<QueryGroup>(required, excluded);
+            m_entityManager.forEachWithMask([&group](Entity e, ALKAHEST_MASK_TYPE mask) {
+                if (group->matches(mask))
+                    group->add(e);
+            });
+
+            (required | excluded).forEach([&](size_t type) {
+                m_groupsByComponent[type].push_back(group.get());
+            });
+            if (required.none())
+                m_unfilteredGroups.push_back(group.get());
+
+            m_groups.push_back(std::move(group));
+            return m_groups.back().get();
         };
 
-        void EntityMaskChanged(Entity e, ALKAHEST_MASK_TYPE mask)
+        // Systems and their masks live in flat tables indexed by the
+        // system's type index, grown as new types show up
+        template<typename T>
+        size_t slotFor()
         {
-            for (auto const& pair : m_systems)
+            size_t type = TypeIndex<System>::assign<T>();
+            if (type >= m_systems.size())
             {
-                auto const& type = pair.first;
-                auto const& system = pair.second;
-                auto const& systemMask = m_masks[type];
+                m_systems.resize(type + 1);
+                m_masks.resize(type + 1);
+                m_excludes.resize(type + 1);
+                m_reads.resize(type + 1);
+                m_writes.resize(type + 1);
+            }
+            return type;
+        };
+
+        bool conflicts(size_t a, size_t b) const
+        {
+            bool aDeclared = (m_reads[a] | m_writes[a]).any();
+            bool bDeclared = (m_reads[b] | m_writes[b]).any();
+            if (!aDeclared || !bDeclared)
+                return true;
+
+            return m_writes[a].intersects(m_reads[b] | m_writes[b])
+                || m_writes[b].intersects(m_reads[a]);
+        };
 
-                if ((mask & systemMask) == systemMask)
-                    system->addEntity(e);
-                else
-                    system->removeEntity(e);
+        void buildSchedule()
+        {
+            m_schedule = std::vector<ScheduleNode>(m_order.size());
+            for (size_t j = 0; j < m_order.size(); j++)
+            {
+                m_schedule[j].system = m_systems[m_order[j]].get();
+                for (size_t i = 0; i < j; i++)
+                {
+                    if (conflicts(m_order[i], m_order[j]))
+                    {
+                        m_schedule[i].dependents.push_back(j);
+                        m_schedule[j].dependencies++;
+                    }
+                }
             }
+
+            m_scheduleDirty = false;
         };
+
+        // Every run starts a new change tick, so the changes a system sees
+        // through getLastRunTick() are exactly those made since it last
+        // started. Defined in world.h.
+        void runScheduled(size_t node, JobCounter& counter);
     private:
-        std::unordered_map<const char*, ALKAHEST_MASK_TYPE> m_masks{};
-        std::unordered_map<const char*, std::shared_ptr<System>> m_systems{};
+        struct ScheduleNode
+        {
+            System* system{};
+            std::vector<size_t> dependents{};
+            uint32_t dependencies{};
+            std::atomic<uint32_t> pending{};
+
+            ScheduleNode() = default;
+            ScheduleNode(ScheduleNode&& other) noexcept :
+                system(other.system), dependents(std::move(other.dependents)),
+                dependencies(other.dependencies) {};
+        };
+
+        World& m_world;
+        const EntityManager& m_entityManager;
+        ComponentManager& m_componentManager;
+
+        std::vector<ALKAHEST_MASK_TYPE> m_masks{};
+        std::vector<ALKAHEST_MASK_TYPE> m_excludes{};
+        std::vector<ALKAHEST_MASK_TYPE> m_reads{};
+        std::vector<ALKAHEST_MASK_TYPE> m_writes{};
+        std::vector<std::shared_ptr<System>> m_systems{};
+        // Slots of the registered systems in registration order, since
+        // type indices are shared by every world and follow the order
+        // types are first seen in the process
+        std::vector<size_t> m_order{};
+
+        std::vector<std::unique_ptr<QueryGroup>> m_groups{};
+        std::array<std::vector<QueryGroup*>, ALKAHEST_COMPONENT_LIMIT> m_groupsByComponent{};
+        std::vector<QueryGroup*> m_unfilteredGroups{};
+
+        std::vector<ScheduleNode> m_schedule{};
+        bool m_scheduleDirty = false;
     };
 }
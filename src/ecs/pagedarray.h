@@ -0,0 +1,138 @@
+#pragma once
+
+#include "../macros.h"
+
+namespace Alkahest
+{
+    // A densely packed array stored in fixed-size pages. Pages are only
+    // allocated as the array grows and are never moved once allocated, so
+    // references to elements stay valid while other elements are added,
+    // and memory use follows the number of live elements.
+    template<typename T, size_t PageSize>
+    class NOT_EXPORTED PagedArray
+    {
+        static_assert((PageSize & (PageSize - 1)) == 0, "PageSize must be a power of two");
+    public:
+        static constexpr size_t pageSize = PageSize;
+
+        PagedArray() = default;
+        PagedArray(const PagedArray&) = delete;
+        PagedArray& operator=(const PagedArray&) = delete;
+
+        ~PagedArray()
+        {
+            clear();
+            for (T* page : m_pages)
+                freePage(page);
+        };
+
+        T& operator[](size_t i) { return m_pages[i / PageSize][i % PageSize]; };
+        const T& operator[](size_t i) const { return m_pages[i / PageSize][i % PageSize]; };
+
+        size_t size() const { return m_size; };
+        bool empty() const { return m_size == 0; };
+
+        // Elements [p * pageSize, min((p + 1) * pageSize, size())) are
+        // contiguous starting at page(p)
+        T* page(size_t p) { return m_pages[p]; };
+        const T* page(size_t p) const { return m_pages[p]; };
+        size_t pageCount() const { return (m_size + PageSize - 1) / PageSize; };
+
+        template<typename... Args>
+        T& emplace_back(Args&&... args)
+        {
+            if (m_size == m_pages.size() * PageSize)
+                m_pages.push_back(allocatePage());
+
+            T* slot = &m_pages[m_size / PageSize][m_size % PageSize];
+            new (slot) T(std::forward<Args>(args)...);
+            m_size++;
+            return *slot;
+        };
+
+        void push_back(T value) { emplace_back(std::move(value)); };
+
+        // Appends `count` copies of value, filling a page at a time
+        void append(size_t count, const T& value)
+        {
+            while (count > 0)
+            {
+                if (m_size == m_pages.size() * PageSize)
+                    m_pages.push_back(allocatePage());
+
+                size_t offset = m_size % PageSize;
+                size_t n = std::min(count, PageSize - offset);
+                std::uninitialized_fill_n(m_pages[m_size / PageSize] + offset, n, value);
+                m_size += n;
+                count -= n;
+            }
+        };
+
+        // Appends `count` elements copied bytewise from `values`, which
+        // need not be aligned, a page at a time. T must be trivially
+        // copyable.
+        void appendBytes(const void* values, size_t count)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "appendBytes requires a trivially copyable type");
+
+            const std::byte* src = static_cast<const std::byte*>(values);
+            while (count > 0)
+            {
+                if (m_size == m_pages.size() * PageSize)
+                    m_pages.push_back(allocatePage());
+
+                size_t offset = m_size % PageSize;
+                size_t n = std::min(count, PageSize - offset);
+                std::memcpy(m_pages[m_size / PageSize] + offset, src, n * sizeof(T));
+                src += n * sizeof(T);
+                m_size += n;
+                count -= n;
+            }
+        };
+
+        void pop_back()
+        {
+            m_size--;
+            (*this)[m_size].~T();
+
+            // Keep one spare page around so an add/remove pair on a page
+            // boundary doesn't allocate every time
+            if (m_pages.size() * PageSize - m_size > 2 * PageSize)
+            {
+                freePage(m_pages.back());
+                m_pages.pop_back();
+            }
+        };
+
+        void clear()
+        {
+            while (m_size > 0)
+            {
+                m_size--;
+                (*this)[m_size].~T();
+            }
+        };
+
+        // Exchanges the pages of two arrays, so no element is moved
+        void swap(PagedArray& other)
+        {
+            m_pages.swap(other.m_pages);
+            std::swap(m_size, other.m_size);
+        };
+    private:
+        static constexpr std::align_val_t pageAlignment{ alignof(T) > 64 ? alignof(T) : 64 };
+
+        static T* allocatePage()
+        {
+            return static_cast<T*>(::operator new(sizeof(T) * PageSize, pageAlignment));
+        };
+
+        static void freePage(T* page)
+        {
+            ::operator delete(page, pageAlignment);
+        };
+    private:
+        std::vector<T*> m_pages{};
+        size_t m_size{};
+    };
+}
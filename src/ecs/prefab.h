@@ -0,0 +1,82 @@
+#pragma once
+
+#include "../macros.h"
+#include "common.h"
+#include "typeid.h"
+#include "../sys/log/log.h"
+
+namespace Alkahest
+{
+    class NOT_EXPORTED BasePrefabComponent
+    {
+    public:
+        virtual ~BasePrefabComponent() = default;
+        virtual const void* data() const = 0;
+    };
+
+    template<typename T>
+    class NOT_EXPORTED PrefabComponent : public BasePrefabComponent
+    {
+    public:
+        PrefabComponent(T value) : m_value(std::move(value)) {};
+
+        T& get() { return m_value; };
+        const void* data() const override { return &m_value; };
+    private:
+        T m_value;
+    };
+
+    // A fixed set of component values that new entities can be stamped
+    // out from in bulk with ECSManager::spawnBatch, e.g.
+    //     Prefab bullet;
+    //     bullet.set(TransformComponent{ ... }).set(Bullet{ ... });
+    //     ECSManager::spawnBatch(bullet, 1000);
+    class API Prefab
+    {
+    public:
+        Prefab() = default;
+        Prefab(Prefab&&) = default;
+        Prefab& operator=(Prefab&&) = default;
+
+        // Adds the component to the prefab, or replaces its value
+        template<typename T>
+        Prefab& set(T component)
+        {
+            size_t type = TypeIndex<Component>::assign<T>();
+            if (type >= ALKAHEST_COMPONENT_LIMIT)
+            {
+                logError("Component limit reached! Type: {}", typeid(T).name());
+                throw AlkahestError{};
+            }
+
+            if (type >= m_components.size())
+                m_components.resize(type + 1);
+            m_components[type] = std::make_unique<PrefabComponent<T>>(std::move(component));
+            m_mask.set(type);
+            return *this;
+        };
+
+        template<typename T>
+        T& get()
+        {
+            size_t type = TypeIndex<Component>::get<T>();
+            if (type >= m_components.size() || !m_components[type])
+            {
+                logError("Attempting to retrieve a component the prefab doesn't have!");
+                throw AlkahestError{};
+            }
+            return static_cast<PrefabComponent<T>&>(*m_components[type]).get();
+        };
+
+        ALKAHEST_MASK_TYPE getMask() const { return m_mask; };
+
+        // The value of the component with the given type index, or nullptr
+        const void* data(size_t type) const
+        {
+            return type < m_components.size() && m_components[type] ? m_components[type]->data() : nullptr;
+        };
+    private:
+        std::vector<std::unique_ptr<BasePrefabComponent>> m_components{};
+        ALKAHEST_MASK_TYPE m_mask{};
+    };
+}
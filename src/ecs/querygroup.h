@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../macros.h"
+#include "common.h"
+#include "entity.h"
+#include "sparseindex.h"
+
+namespace Alkahest
+{
+    // The cached set of entities whose mask contains every required
+    // component and none of the excluded ones. Groups are kept up to date
+    // incrementally as masks change, and store their entities in a dense
+    // list so systems can walk them linearly.
+    class NOT_EXPORTED QueryGroup
+    {
+    public:
+        QueryGroup(ALKAHEST_MASK_TYPE required, ALKAHEST_MASK_TYPE excluded) :
+            m_required(required), m_excluded(excluded) {};
+
+        ALKAHEST_MASK_TYPE getRequired() const { return m_required; };
+        ALKAHEST_MASK_TYPE getExcluded() const { return m_excluded; };
+
+        // Only entities with at least one component are ever grouped
+        bool matches(ALKAHEST_MASK_TYPE mask) const
+        {
+            return mask.any() && mask.contains(m_required) && !mask.intersects(m_excluded);
+        };
+
+        void add(Entity e)
+        {
+            SparseIndex::Index& slot = m_sparse.slot(e.ID);
+            if (slot != SparseIndex::null)
+                return;
+
+            slot = static_cast<SparseIndex::Index>(m_entities.size());
+            m_entities.push_back(e);
+        };
+
+        void add(const std::vector<Entity>& entities)
+        {
+            m_entities.reserve(m_entities.size() + entities.size());
+            for (Entity e : entities)
+                add(e);
+        };
+
+        void remove(Entity e)
+        {
+            SparseIndex::Index index = m_sparse.get(e.ID);
+            if (index == SparseIndex::null)
+                return;
+
+            Entity last = m_entities.back();
+            m_entities[index] = last;
+            m_sparse.slot(last.ID) = index;
+            m_sparse.slot(e.ID) = SparseIndex::null;
+            m_entities.pop_back();
+        };
+
+        void clear()
+        {
+            for (Entity e : m_entities)
+                m_sparse.slot(e.ID) = SparseIndex::null;
+            m_entities.clear();
+        };
+
+        const std::vector<Entity>& entities() const { return m_entities; };
+        size_t size() const { return m_entities.size(); };
+    private:
+        ALKAHEST_MASK_TYPE m_required;
+        ALKAHEST_MASK_TYPE m_excluded;
+        std::vector<Entity> m_entities{};
+        SparseIndex m_sparse{};
+    };
+}
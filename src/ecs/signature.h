@@ -0,0 +1,225 @@
+#pragma once
+
+#include "../macros.h"
+
+#if defined(ALKAHEST_SIMD_AVX)
+#include <immintrin.h>
+#elif defined(ALKAHEST_SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Alkahest
+{
+    // A fixed-width bitset with one bit per component type, used for the
+    // component masks of entities, archetypes and queries. The subset and
+    // overlap tests that query matching is made of are done 256 bits at a
+    // time with AVX (when the width allows), or 128 bits at a time with
+    // SSE2, without branching on any individual word.
+    template<size_t Bits>
+    class NOT_EXPORTED Signature
+    {
+        static_assert(Bits > 0 && Bits % 128 == 0, "Signature width must be a multiple of 128 bits");
+    public:
+        static constexpr size_t bits = Bits;
+
+        constexpr Signature() = default;
+
+        static Signature bit(size_t index)
+        {
+            Signature s;
+            s.set(index);
+            return s;
+        };
+
+        void set(size_t index) { m_words[index / 64] |= one << (index % 64); };
+        void reset(size_t index) { m_words[index / 64] &= ~(one << (index % 64)); };
+        bool test(size_t index) const { return (m_words[index / 64] >> (index % 64)) & 1; };
+
+        bool any() const
+        {
+            std::uint64_t set = 0;
+            for (size_t w = 0; w < words; w++)
+                set |= m_words[w];
+            return set != 0;
+        };
+
+        bool none() const { return !any(); };
+
+        // Number of set bits
+        size_t count() const
+        {
+            size_t n = 0;
+            for (size_t w = 0; w < words; w++)
+                n += popCount(m_words[w]);
+            return n;
+        };
+
+        // Whether every bit set in `other` is also set in this signature
+        bool contains(const Signature& other) const
+        {
+#if defined(ALKAHEST_SIMD_AVX)
+            if constexpr (words % 4 == 0)
+            {
+                int result = 1;
+                for (size_t w = 0; w < words; w += 4)
+                    result &= _mm256_testc_si256(load256(w), other.load256(w));
+                return result != 0;
+            }
+#endif
+#if defined(ALKAHEST_SIMD_SSE2)
+            __m128i missing = _mm_setzero_si128();
+            for (size_t w = 0; w < words; w += 2)
+                missing = _mm_or_si128(missing, _mm_andnot_si128(load128(w), other.load128(w)));
+            return isZero(missing);
+#else
+            std::uint64_t missing = 0;
+            for (size_t w = 0; w < words; w++)
+                missing |= other.m_words[w] & ~m_words[w];
+            return missing == 0;
+#endif
+        };
+
+        // Whether the two signatures have any bit in common
+        bool intersects(const Signature& other) const
+        {
+#if defined(ALKAHEST_SIMD_AVX)
+            if constexpr (words % 4 == 0)
+            {
+                int disjoint = 1;
+                for (size_t w = 0; w < words; w += 4)
+                    disjoint &= _mm256_testz_si256(load256(w), other.load256(w));
+                return disjoint == 0;
+            }
+#endif
+#if defined(ALKAHEST_SIMD_SSE2)
+            __m128i common = _mm_setzero_si128();
+            for (size_t w = 0; w < words; w += 2)
+                common = _mm_or_si128(common, _mm_and_si128(load128(w), other.load128(w)));
+            return !isZero(common);
+#else
+            std::uint64_t common = 0;
+            for (size_t w = 0; w < words; w++)
+                common |= other.m_words[w] & m_words[w];
+            return common != 0;
+#endif
+        };
+
+        // Calls fn(index) for every set bit, in ascending order
+        template<typename Fn>
+        void forEach(Fn&& fn) const
+        {
+            for (size_t w = 0; w < words; w++)
+            {
+                for (std::uint64_t word = m_words[w]; word != 0; word &= word - 1)
+                    fn(w * 64 + countTrailingZeros(word));
+            }
+        };
+
+        Signature& operator&=(const Signature& other)
+        {
+            for (size_t w = 0; w < words; w++)
+                m_words[w] &= other.m_words[w];
+            return *this;
+        };
+
+        Signature& operator|=(const Signature& other)
+        {
+            for (size_t w = 0; w < words; w++)
+                m_words[w] |= other.m_words[w];
+            return *this;
+        };
+
+        Signature& operator^=(const Signature& other)
+        {
+            for (size_t w = 0; w < words; w++)
+                m_words[w] ^= other.m_words[w];
+            return *this;
+        };
+
+        friend Signature operator&(Signature a, const Signature& b) { return a &= b; };
+        friend Signature operator|(Signature a, const Signature& b) { return a |= b; };
+        friend Signature operator^(Signature a, const Signature& b) { return a ^= b; };
+
+        Signature operator~() const
+        {
+            Signature s;
+            for (size_t w = 0; w < words; w++)
+                s.m_words[w] = ~m_words[w];
+            return s;
+        };
+
+        bool operator==(const Signature& other) const
+        {
+            std::uint64_t difference = 0;
+            for (size_t w = 0; w < words; w++)
+                difference |= m_words[w] ^ other.m_words[w];
+            return difference == 0;
+        };
+
+        bool operator!=(const Signature& other) const { return !(*this == other); };
+
+        size_t hash() const
+        {
+            std::uint64_t h = 0;
+            for (size_t w = 0; w < words; w++)
+                h = (h ^ m_words[w]) * 0x100000001b3ull;
+            return h ^ (h >> 32);
+        };
+    private:
+        static constexpr size_t words = Bits / 64;
+        static constexpr std::uint64_t one = 1;
+
+        static size_t countTrailingZeros(std::uint64_t word)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward64(&index, word);
+            return index;
+#else
+            return static_cast<size_t>(__builtin_ctzll(word));
+#endif
+        };
+
+        static size_t popCount(std::uint64_t word)
+        {
+#if defined(_MSC_VER)
+            return static_cast<size_t>(__popcnt64(word));
+#else
+            return static_cast<size_t>(__builtin_popcountll(word));
+#endif
+        };
+
+#if defined(ALKAHEST_SIMD_AVX)
+        __m256i load256(size_t w) const
+        {
+            return _mm256_load_si256(reinterpret_cast<const __m256i*>(&m_words[w]));
+        };
+#endif
+#if defined(ALKAHEST_SIMD_SSE2)
+        __m128i load128(size_t w) const
+        {
+            return _mm_load_si128(reinterpret_cast<const __m128i*>(&m_words[w]));
+        };
+
+        static bool isZero(__m128i v)
+        {
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) == 0xFFFF;
+        };
+#endif
+
+        alignas(32) std::uint64_t m_words[words]{};
+    };
+}
+
+namespace std
+{
+    template<size_t Bits>
+    struct hash<Alkahest::Signature<Bits>>
+    {
+        size_t operator()(const Alkahest::Signature<Bits>& s) const { return s.hash(); };
+    };
+}
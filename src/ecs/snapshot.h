@@ -0,0 +1,189 @@
+#pragma once
+
+#include "../macros.h"
+#include "common.h"
+#include "../sys/log/log.h"
+
+namespace Alkahest
+{
+    // Bumped whenever the layout written by ECSManager::snapshot() changes
+    #define ALKAHEST_SNAPSHOT_VERSION 1
+
+    // A binary image of an ECS world, produced by ECSManager::snapshot()
+    // and consumed by ECSManager::restore(). Each storage is written as a
+    // handful of contiguous blocks (entity IDs, then the data of each
+    // component type) so both directions are mostly bulk memcpy.
+    //
+    // Snapshots are only meant to be read back by the same build on the
+    // same platform: data is written in native byte order, and the type
+    // table only guards against registered types having changed.
+    class NOT_EXPORTED Snapshot
+    {
+    public:
+        Snapshot() = default;
+        explicit Snapshot(std::vector<std::byte> data) : m_data(std::move(data)) {};
+
+        const std::byte* data() const { return m_data.data(); };
+        size_t size() const { return m_data.size(); };
+
+        void write(const void* data, size_t size)
+        {
+            const std::byte* bytes = static_cast<const std::byte*>(data);
+            m_data.insert(m_data.end(), bytes, bytes + size);
+        };
+
+        template<typename T>
+        void write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be written directly");
+            write(&value, sizeof(T));
+        };
+
+        void writeString(const std::string& s)
+        {
+            write(static_cast<uint32_t>(s.size()));
+            write(s.data(), s.size());
+        };
+
+        // Identifies the format and the build settings the layout of the
+        // rest of the snapshot depends on
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t entityIndexBits;
+            uint32_t componentLimit;
+            uint32_t archetypeStorage;
+
+            static Header current()
+            {
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+                uint32_t archetypeStorage = 1;
+#else
+                uint32_t archetypeStorage = 0;
+#endif
+                return { magicNumber, ALKAHEST_SNAPSHOT_VERSION, ALKAHEST_ENTITY_INDEX_BITS,
+                    ALKAHEST_COMPONENT_LIMIT, archetypeStorage };
+            };
+
+            // "AKSN"
+            static constexpr uint32_t magicNumber = 0x4E534B41;
+        };
+
+        void saveToFile(const std::string& path) const
+        {
+            std::ofstream fileOut(path, std::ios::out | std::ios::binary);
+            if (!fileOut
+                || !fileOut.write(reinterpret_cast<const char*>(m_data.data()), m_data.size()))
+            {
+                logError("Unable to write snapshot! Path: {}", path);
+                throw AlkahestError{};
+            }
+        };
+
+        static Snapshot loadFromFile(const std::string& path)
+        {
+            std::ifstream fileIn(path, std::ios::in | std::ios::binary);
+            if (!fileIn)
+            {
+                logError("Unable to open snapshot! Path: {}", path);
+                throw AlkahestError{};
+            }
+
+            std::vector<std::byte> data;
+            fileIn.seekg(0, std::ios::end);
+            data.resize(static_cast<size_t>(fileIn.tellg()));
+            fileIn.seekg(0, std::ios::beg);
+            if (!fileIn.read(reinterpret_cast<char*>(data.data()), data.size()))
+            {
+                logError("Unable to read snapshot! Path: {}", path);
+                throw AlkahestError{};
+            }
+            return Snapshot(std::move(data));
+        };
+
+        // A read cursor over a snapshot, so the same snapshot can be
+        // restored any number of times (e.g. for rollback)
+        class NOT_EXPORTED Reader
+        {
+        public:
+            explicit Reader(const Snapshot& snapshot) : m_snapshot(snapshot) {};
+
+            size_t remaining() const { return m_snapshot.size() - m_offset; };
+
+            // Checks a block length before anything is sized by it, so a
+            // corrupt count is rejected instead of allocated
+            void checkCount(size_t count, size_t elementSize)
+            {
+                if (count > ALKAHEST_ENTITY_LIMIT || count * elementSize > remaining())
+                {
+                    logError("Snapshot block count is invalid! Count: {}", count);
+                    throw AlkahestError{};
+                }
+            };
+
+            // Returns the next `size` bytes in place and moves past them
+            const std::byte* skip(size_t size)
+            {
+                if (size > remaining())
+                {
+                    logError("Snapshot is truncated! Size: {}", m_snapshot.size());
+                    throw AlkahestError{};
+                }
+                const std::byte* bytes = m_snapshot.data() + m_offset;
+                m_offset += size;
+                return bytes;
+            };
+
+            // Empty storages hand in a null pointer, which memcpy rejects
+            void read(void* data, size_t size)
+            {
+                const std::byte* bytes = skip(size);
+                if (size > 0)
+                    std::memcpy(data, bytes, size);
+            };
+
+            template<typename T>
+            T read()
+            {
+                static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be read directly");
+                T value;
+                read(&value, sizeof(T));
+                return value;
+            };
+
+            std::string readString()
+            {
+                uint32_t size = read<uint32_t>();
+                const std::byte* bytes = skip(size);
+                return std::string(reinterpret_cast<const char*>(bytes), size);
+            };
+
+            // Reads the header and checks that it was written by a build
+            // with the same settings as this one
+            void checkHeader()
+            {
+                Header header = read<Header>();
+                Header expected = Header::current();
+                if (header.magic != Header::magicNumber)
+                {
+                    logError("Data is not an ECS snapshot!");
+                    throw AlkahestError{};
+                }
+                if (header.version != expected.version
+                    || header.entityIndexBits != expected.entityIndexBits
+                    || header.componentLimit != expected.componentLimit
+                    || header.archetypeStorage != expected.archetypeStorage)
+                {
+                    logError("Snapshot was written with different ECS settings! Version: {}", header.version);
+                    throw AlkahestError{};
+                }
+            };
+        private:
+            const Snapshot& m_snapshot;
+            size_t m_offset{};
+        };
+    private:
+        std::vector<std::byte> m_data{};
+    };
+}
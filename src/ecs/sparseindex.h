@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../macros.h"
+#include "common.h"
+#include "entity.h"
+
+namespace Alkahest
+{
+    // Maps entity indices to positions in some dense array. The index is
+    // split into pages of ALKAHEST_SPARSE_PAGE_SIZE entries that are only
+    // allocated once an entity in their range is inserted.
+    class NOT_EXPORTED SparseIndex
+    {
+    public:
+        using Index = ALKAHEST_ENTITY_ID_TYPE;
+        static constexpr Index null = std::numeric_limits<Index>::max();
+
+        // Returns the position stored for the ID's index, or null
+        Index get(ALKAHEST_ENTITY_ID_TYPE id) const
+        {
+            size_t page = entityIndex(id) / ALKAHEST_SPARSE_PAGE_SIZE;
+            if (page >= m_pages.size() || !m_pages[page])
+                return null;
+            return (*m_pages[page])[entityIndex(id) % ALKAHEST_SPARSE_PAGE_SIZE];
+        };
+
+        // Returns the slot for the ID's index, allocating its page on demand
+        Index& slot(ALKAHEST_ENTITY_ID_TYPE id)
+        {
+            size_t page = entityIndex(id) / ALKAHEST_SPARSE_PAGE_SIZE;
+            if (page >= m_pages.size())
+                m_pages.resize(page + 1);
+            if (!m_pages[page])
+            {
+                m_pages[page] = std::make_unique<Page>();
+                m_pages[page]->fill(null);
+            }
+            return (*m_pages[page])[entityIndex(id) % ALKAHEST_SPARSE_PAGE_SIZE];
+        };
+    private:
+        using Page = std::array<Index, ALKAHEST_SPARSE_PAGE_SIZE>;
+
+        std::vector<std::unique_ptr<Page>> m_pages{};
+    };
+}
@@ -3,42 +3,82 @@
 #include "../../macros.h"
 #include "../common.h"
 #include "../entity.h"
+#include "../querygroup.h"
 
 namespace Alkahest
 {
+    // Forward declare View, CommandBuffer and World classes
+    template<typename... Ts> class View;
+    class CommandBuffer;
+    class World;
+
     class API System
     {
+        friend class SystemManager;
     public:
         System() {};
         virtual ~System() {};
-        virtual void process(Entity e) = 0;
+
+        // Systems either override process() to handle one matching entity
+        // at a time, or override update() and iterate a view directly:
+        //
+        //     void update() override
+        //     {
+        //         view<TransformComponent, Velocity>().each(
+        //             [](TransformComponent& t, Velocity& v) { ... });
+        //     }
+        virtual void process(Entity) {};
+        virtual void update() { processAll(); };
     public:
         virtual void processAll() final
         {
-            for (auto const& pair : m_entities)
-            {
-                auto const& entity = pair.second;
-                process(entity);
-            }
-        };
-
-        virtual void addEntity(Entity e) final
-        {
-            m_entities.insert({ e.ID, e });
-        };
+            if (m_group == nullptr)
+                return;
 
-        virtual void removeEntity(Entity e) final
-        {
-            m_entities.erase(e.ID);
+            const std::vector<Entity>& entities = m_group->entities();
+            for (size_t i = 0; i < entities.size(); i++)
+                process(entities[i]);
         };
 
-        virtual void EntityDestroyed(Entity e) final
+        size_t getEntityCount() const
         {
-            if (m_entities.find(e.ID) != m_entities.end())
-                removeEntity(e);
+            return m_group != nullptr ? m_group->size() : 0;
         };
     protected:
-        std::unordered_map<ALKAHEST_ENTITY_ID_TYPE, Entity> m_entities{};
+        // The change tick this system's previous update started on, or 0
+        // before its first update. Passing it to View::changed() limits
+        // the view to components changed since then.
+        ALKAHEST_TICK_TYPE getLastRunTick() const { return m_lastRunTick; };
+
+        // The world the system was registered with
+        World& getWorld() const { return *m_world; };
+
+        // A view over the system's world. Defined in world.h.
+        template<typename... Ts>
+        View<Ts...> view();
+
+        // Read-only access to a component in the system's world, which
+        // leaves the change tick alone. Components a system only declares
+        // as read must be fetched this way (or through const view
+        // callbacks), since getComponent() writes the tick. Defined in
+        // world.h.
+        template<typename T>
+        const T& readComponent(Entity e);
+
+        // The calling thread's command buffer for the system's world.
+        // Systems must record structural changes here instead of making
+        // them directly, since other systems may be iterating at the same
+        // time. Defined in world.h.
+        CommandBuffer& commands();
+
+        // The entities matching this system's mask, shared with every
+        // other system using the same mask and kept up to date by the
+        // SystemManager
+        const QueryGroup* m_group = nullptr;
+    private:
+        World* m_world = nullptr;
+        ALKAHEST_TICK_TYPE m_lastRunTick = 0;
+        ALKAHEST_TICK_TYPE m_runTick = 0;
     };
 
     namespace Systems
@@ -1,4 +1,5 @@
 #pragma once
 
 #include "_base.h"
+#include "transform.h"
 
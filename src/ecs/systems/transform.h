@@ -0,0 +1,352 @@
+#pragma once
+
+#include "_base.h"
+#include "../components/transform.h"
+#include "../components/parent.h"
+#include "../sparseindex.h"
+#include "../../util/simd.h"
+#include "../../sys/log/log.h"
+
+#include <glm/glm.hpp>
+
+namespace Alkahest
+{
+    namespace Systems
+    {
+        // Computes a world matrix for every entity with a TransformComponent,
+        // composed the same way as Transform::getMatrix() (translation, then
+        // rotation from Euler angles where 1 = 360 degrees, then scale) and
+        // multiplied by the parent's world matrix for entities with a
+        // ParentComponent.
+        //
+        // The transforms are kept in SoA arrays. Each update only copies in
+        // the components changed since the previous one, and only those
+        // entities (and the children of any that moved) are recomputed.
+        // Local matrices are built Simd::Widest::width entities at a time.
+        class API TransformSystem : public System
+        {
+        public:
+            void update() override
+            {
+                gather();
+                composeDirty();
+                resolveHierarchy();
+            };
+
+            const glm::mat4& getWorldMatrix(Entity e) const
+            {
+                uint32_t slot = find(e.ID);
+                if (slot == none)
+                {
+                    logError("Attempting to retrieve the world matrix of an entity without a transform!");
+                    throw AlkahestError{};
+                }
+                return m_world[slot];
+            };
+
+            // Forces every matrix to be recomputed on the next update
+            void invalidate() { m_invalidated = true; };
+        private:
+            using Lanes = Simd::Widest;
+            static constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+            // Marks slots that no entity has taken yet. IDs at and above the
+            // entity limit are ordinary IDs with a non-zero generation.
+            static constexpr ALKAHEST_ENTITY_ID_TYPE noEntity = std::numeric_limits<ALKAHEST_ENTITY_ID_TYPE>::max();
+
+            uint32_t find(ALKAHEST_ENTITY_ID_TYPE id) const
+            {
+                SparseIndex::Index slot = m_slots.get(id);
+                return slot < m_count && m_ids[slot] == id ? slot : none;
+            };
+
+            // Arrays are padded to a whole number of lanes so the last
+            // batch can always load a full register
+            void reserve(size_t count)
+            {
+                if (count <= m_ids.size())
+                    return;
+
+                size_t padded = (count + Lanes::width - 1) / Lanes::width * Lanes::width;
+                padded = std::max(padded, m_ids.size() * 2);
+
+                m_ids.resize(padded, noEntity);
+                for (size_t axis = 0; axis < 3; axis++)
+                {
+                    m_position[axis].resize(padded, 0.0f);
+                    m_rotation[axis].resize(padded, 0.0f);
+                    m_scale[axis].resize(padded, 1.0f);
+                }
+                m_dirty.resize(padded, 1);
+                m_parents.resize(padded, none);
+                m_depth.resize(padded, 0);
+                m_local.resize(padded, glm::mat4(1.0f));
+                m_world.resize(padded, glm::mat4(1.0f));
+            };
+
+            // Assigns every entity a slot, then copies in the components that
+            // changed since the last update. Slots that changed hands, or
+            // were past the end last time, are copied in full.
+            void gather()
+            {
+                uint32_t count = 0;
+                uint32_t previous = m_count;
+                bool invalidated = m_invalidated;
+                view<Components::TransformComponent>().each(
+                    [this, &count, previous, invalidated](Entity e, const Components::TransformComponent& t)
+                    {
+                        uint32_t slot = count++;
+                        reserve(count);
+
+                        if (slot >= previous || m_ids[slot] != e.ID)
+                        {
+                            m_ids[slot] = e.ID;
+                            m_slots.slot(e.ID) = slot;
+                            m_hierarchyChanged = true;
+                        }
+                        else if (!invalidated)
+                        {
+                            return;
+                        }
+                        copy(slot, t);
+                    });
+
+                m_hierarchyChanged |= count != m_count;
+                m_count = count;
+                m_invalidated = false;
+
+                view<Components::TransformComponent>().changed<Components::TransformComponent>(getLastRunTick()).each(
+                    [this](Entity e, const Components::TransformComponent& t)
+                    {
+                        uint32_t slot = find(e.ID);
+                        if (slot != none)
+                            copy(slot, t);
+                    });
+            };
+
+            void copy(uint32_t slot, const Components::TransformComponent& t)
+            {
+                for (size_t axis = 0; axis < 3; axis++)
+                {
+                    m_position[axis][slot] = t.Position[axis];
+                    m_rotation[axis][slot] = t.Rotation[axis];
+                    m_scale[axis][slot] = t.Scale[axis];
+                }
+                m_dirty[slot] = 1;
+            };
+
+            void composeDirty()
+            {
+                for (size_t begin = 0; begin < m_count; begin += Lanes::width)
+                {
+                    bool dirty = false;
+                    for (size_t i = begin; i < begin + Lanes::width; i++)
+                        dirty |= m_dirty[i] != 0;
+
+                    if (dirty)
+                        compose<Lanes>(begin);
+                }
+            };
+
+            // Builds T * R * S for the `L::width` slots starting at begin.
+            // R comes from the quaternion of the Euler angles, matching
+            // glm::mat4_cast(glm::quat(euler)).
+            template<typename L>
+            void compose(size_t begin)
+            {
+                using F = typename L::Float;
+
+                // Half of the angle in radians is rotation * pi
+                F sx, cx, sy, cy, sz, cz;
+                Simd::sinCosPi<L>(L::load(&m_rotation[0][begin]), sx, cx);
+                Simd::sinCosPi<L>(L::load(&m_rotation[1][begin]), sy, cy);
+                Simd::sinCosPi<L>(L::load(&m_rotation[2][begin]), sz, cz);
+
+                F cycz = L::mul(cy, cz), sysz = L::mul(sy, sz);
+                F sycz = L::mul(sy, cz), cysz = L::mul(cy, sz);
+                F qw = L::add(L::mul(cx, cycz), L::mul(sx, sysz));
+                F qx = L::sub(L::mul(sx, cycz), L::mul(cx, sysz));
+                F qy = L::add(L::mul(cx, sycz), L::mul(sx, cysz));
+                F qz = L::sub(L::mul(cx, cysz), L::mul(sx, sycz));
+
+                F two = L::set(2.0f), one = L::set(1.0f);
+                F xx = L::mul(qx, qx), yy = L::mul(qy, qy), zz = L::mul(qz, qz);
+                F xy = L::mul(qx, qy), xz = L::mul(qx, qz), yz = L::mul(qy, qz);
+                F wx = L::mul(qw, qx), wy = L::mul(qw, qy), wz = L::mul(qw, qz);
+
+                F scaleX = L::load(&m_scale[0][begin]);
+                F scaleY = L::load(&m_scale[1][begin]);
+                F scaleZ = L::load(&m_scale[2][begin]);
+
+                // Column-major, [column][row]
+                alignas(32) float out[12][L::width];
+                L::store(out[0], L::mul(L::sub(one, L::mul(two, L::add(yy, zz))), scaleX));
+                L::store(out[1], L::mul(L::mul(two, L::add(xy, wz)), scaleX));
+                L::store(out[2], L::mul(L::mul(two, L::sub(xz, wy)), scaleX));
+                L::store(out[3], L::mul(L::mul(two, L::sub(xy, wz)), scaleY));
+                L::store(out[4], L::mul(L::sub(one, L::mul(two, L::add(xx, zz))), scaleY));
+                L::store(out[5], L::mul(L::mul(two, L::add(yz, wx)), scaleY));
+                L::store(out[6], L::mul(L::mul(two, L::add(xz, wy)), scaleZ));
+                L::store(out[7], L::mul(L::mul(two, L::sub(yz, wx)), scaleZ));
+                L::store(out[8], L::mul(L::sub(one, L::mul(two, L::add(xx, yy))), scaleZ));
+                L::store(out[9], L::load(&m_position[0][begin]));
+                L::store(out[10], L::load(&m_position[1][begin]));
+                L::store(out[11], L::load(&m_position[2][begin]));
+
+                for (size_t lane = 0; lane < L::width; lane++)
+                {
+                    glm::mat4& m = m_local[begin + lane];
+                    for (int column = 0; column < 3; column++)
+                    {
+                        m[column][0] = out[column * 3 + 0][lane];
+                        m[column][1] = out[column * 3 + 1][lane];
+                        m[column][2] = out[column * 3 + 2][lane];
+                        m[column][3] = 0.0f;
+                    }
+                    m[3][0] = out[9][lane];
+                    m[3][1] = out[10][lane];
+                    m[3][2] = out[11][lane];
+                    m[3][3] = 1.0f;
+                }
+            };
+
+            // Roots take their local matrix as is. Children are visited in
+            // order of depth so a parent's world matrix is always final
+            // before its children read it.
+            void resolveHierarchy()
+            {
+                std::vector<uint32_t>& parents = m_scratch;
+                parents.assign(m_count, none);
+                view<Components::ParentComponent>().each([this, &parents](Entity e, const Components::ParentComponent& p) {
+                    uint32_t slot = find(e.ID);
+                    if (slot != none)
+                        parents[slot] = find(p.Parent.ID);
+                });
+
+                // The visiting order only has to be rebuilt when a parent
+                // link or the slot layout changes
+                for (uint32_t slot = 0; slot < m_count; slot++)
+                {
+                    if (parents[slot] != m_parents[slot])
+                    {
+                        m_parents[slot] = parents[slot];
+                        m_dirty[slot] = 1;
+                        m_hierarchyChanged = true;
+                    }
+                }
+                if (m_hierarchyChanged)
+                    sortChildren();
+
+                for (uint32_t slot = 0; slot < m_count; slot++)
+                {
+                    if (m_dirty[slot] && m_parents[slot] == none)
+                        m_world[slot] = m_local[slot];
+                }
+
+                for (uint32_t slot : m_children)
+                {
+                    uint32_t parent = m_parents[slot];
+                    if (m_dirty[slot] || m_dirty[parent])
+                    {
+                        m_world[slot] = multiply(m_world[parent], m_local[slot]);
+                        m_dirty[slot] = 1;
+                    }
+                }
+
+                std::fill(m_dirty.begin(), m_dirty.begin() + m_count, static_cast<uint8_t>(0));
+            };
+
+            void sortChildren()
+            {
+                for (uint32_t slot = 0; slot < m_count; slot++)
+                    m_depth[slot] = m_parents[slot] == none ? 0 : none;
+                for (uint32_t slot = 0; slot < m_count; slot++)
+                {
+                    if (m_depth[slot] == none)
+                        resolveDepth(slot);
+                }
+
+                m_children.clear();
+                for (uint32_t slot = 0; slot < m_count; slot++)
+                {
+                    if (m_parents[slot] != none)
+                        m_children.push_back(slot);
+                }
+                std::stable_sort(m_children.begin(), m_children.end(),
+                    [this](uint32_t a, uint32_t b) { return m_depth[a] < m_depth[b]; });
+
+                m_hierarchyChanged = false;
+            };
+
+            // Walks up to the nearest slot with a known depth, then fills in
+            // the depths on the way back down. A walk longer than the number
+            // of slots must be going around a cycle, which is broken by
+            // detaching the slot it has reached and starting over.
+            void resolveDepth(uint32_t slot)
+            {
+                m_stack.clear();
+                uint32_t current = slot;
+                while (m_depth[current] == none)
+                {
+                    if (m_stack.size() > m_count)
+                    {
+                        logError("Transform hierarchy contains a cycle! Detaching entity {}", m_ids[current]);
+                        m_parents[current] = none;
+                        m_depth[current] = 0;
+                        m_dirty[current] = 1;
+                        resolveDepth(slot);
+                        return;
+                    }
+                    m_stack.push_back(current);
+                    current = m_parents[current];
+                }
+
+                uint32_t depth = m_depth[current];
+                for (size_t i = m_stack.size(); i-- > 0;)
+                    m_depth[m_stack[i]] = ++depth;
+            };
+
+            static glm::mat4 multiply(const glm::mat4& a, const glm::mat4& b)
+            {
+#if defined(ALKAHEST_SIMD_SSE2)
+                glm::mat4 result;
+                __m128 a0 = _mm_loadu_ps(&a[0][0]);
+                __m128 a1 = _mm_loadu_ps(&a[1][0]);
+                __m128 a2 = _mm_loadu_ps(&a[2][0]);
+                __m128 a3 = _mm_loadu_ps(&a[3][0]);
+                for (int column = 0; column < 4; column++)
+                {
+                    __m128 c = _mm_mul_ps(a0, _mm_set1_ps(b[column][0]));
+                    c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(b[column][1])));
+                    c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(b[column][2])));
+                    c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(b[column][3])));
+                    _mm_storeu_ps(&result[column][0], c);
+                }
+                return result;
+#else
+                return a * b;
+#endif
+            };
+        private:
+            uint32_t m_count = 0;
+            bool m_invalidated = false;
+            bool m_hierarchyChanged = false;
+
+            SparseIndex m_slots{};
+            std::vector<ALKAHEST_ENTITY_ID_TYPE> m_ids{};
+            std::array<std::vector<float>, 3> m_position{};
+            std::array<std::vector<float>, 3> m_rotation{};
+            std::array<std::vector<float>, 3> m_scale{};
+            std::vector<uint8_t> m_dirty{};
+
+            std::vector<uint32_t> m_parents{};
+            std::vector<uint32_t> m_depth{};
+            std::vector<uint32_t> m_children{};
+            std::vector<uint32_t> m_stack{};
+            std::vector<uint32_t> m_scratch{};
+
+            std::vector<glm::mat4> m_local{};
+            std::vector<glm::mat4> m_world{};
+        };
+    }
+}
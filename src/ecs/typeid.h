@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../macros.h"
+
+namespace Alkahest
+{
+    // The process-wide table behind TypeIndex. It lives in the engine
+    // library (ecsmanager.cpp) so the library and a client linking it as
+    // a shared library hand out the same indices. Types are told apart by
+    // name, so types in anonymous namespaces need unique names.
+    class API TypeRegistry
+    {
+    public:
+        static constexpr size_t null = std::numeric_limits<size_t>::max();
+
+        // Returns the index of `type` within `family`, or null if it has
+        // none yet and `assign` is false
+        static size_t find(const char* family, const char* type, bool assign);
+    };
+
+    // Hands out sequential, process-wide indices to the types of a family
+    // (components, systems). A type's index is assigned the first time it
+    // is registered, after which looking it up is a single static load,
+    // so it can be used to index flat tables on hot paths. Indices are
+    // shared by every World, and may be assigned from any thread.
+    template<typename Family>
+    class NOT_EXPORTED TypeIndex
+    {
+    public:
+        static constexpr size_t null = TypeRegistry::null;
+
+        // Types without an index are looked up in the registry every
+        // time, since another module may assign one later
+        template<typename T>
+        static size_t get()
+        {
+            size_t index = m_index<T>.load(std::memory_order_acquire);
+            if (index == null)
+                index = fetch<T>(false);
+            return index;
+        };
+
+        template<typename T>
+        static size_t assign()
+        {
+            size_t index = m_index<T>.load(std::memory_order_acquire);
+            if (index == null)
+                index = fetch<T>(true);
+            return index;
+        };
+    private:
+        template<typename T>
+        static size_t fetch(bool assign)
+        {
+            size_t index = TypeRegistry::find(typeid(Family).name(), typeid(T).name(), assign);
+            if (index != null)
+                m_index<T>.store(index, std::memory_order_release);
+            return index;
+        };
+
+        // Each module's cache of the registry's answer
+        template<typename T>
+        static inline std::atomic<size_t> m_index{ null };
+    };
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include "../macros.h"
+#include "common.h"
+#include "entity.h"
+#include "managers/componentmanager.h"
+#include "../sys/jobs/jobsystem.h"
+
+namespace Alkahest
+{
+    // The argument types of a callback, when they can be worked out from
+    // its signature. Generic lambdas can't be inspected.
+    template<typename Fn, typename = void>
+    struct CallbackArgs
+    {
+        static constexpr bool known = false;
+    };
+
+    template<typename Fn>
+    struct CallbackArgs<Fn, std::void_t<decltype(&Fn::operator())>> : CallbackArgs<decltype(&Fn::operator())> {};
+
+    template<typename R, typename C, typename... As>
+    struct CallbackArgs<R (C::*)(As...) const, void>
+    {
+        static constexpr bool known = true;
+        using Args = std::tuple<As...>;
+    };
+
+    template<typename R, typename C, typename... As>
+    struct CallbackArgs<R (C::*)(As...), void> : CallbackArgs<R (C::*)(As...) const, void> {};
+
+    template<typename R, typename... As>
+    struct CallbackArgs<R (*)(As...), void>
+    {
+        static constexpr bool known = true;
+        using Args = std::tuple<As...>;
+    };
+
+    // A View iterates every entity that has all of the given component
+    // types. The storage for each type is resolved once when the view is
+    // created, and each() hands the components straight to the callback
+    // so the loop body can be inlined.
+    //
+    // The callback takes either the component references alone or the
+    // Entity followed by the component references:
+    //
+    //     view.each([](TransformComponent& t, Velocity& v) { ... });
+    //     view.each([](Entity e, TransformComponent& t, Velocity& v) { ... });
+    //
+    // parallelEach() takes the same callbacks but splits the entities
+    // across the JobSystem. The callback must only touch the components
+    // it is handed and must not add or remove components or entities.
+    //
+    // Components the callback takes by non-const reference are stamped as
+    // changed on the view's tick, while const references and copies are
+    // not. changed<T>(since) skips entities whose T hasn't changed at or
+    // after `since`:
+    //
+    //     view.changed<TransformComponent>(getLastRunTick()).each(
+    //         [](const TransformComponent& t) { ... });
+    //
+    // Tags are matched like any other component, and a rare tag makes a
+    // cheap driving set. The callback is handed a shared instance for them.
+    template<typename... Ts>
+    class NOT_EXPORTED View
+    {
+        static_assert(sizeof...(Ts) > 0, "A View requires at least one component type");
+    public:
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+        View(ArchetypeStorage& storage, std::array<ALKAHEST_COMPONENT_ID_TYPE, sizeof...(Ts)> types,
+            ALKAHEST_TICK_TYPE tick)
+            : m_storage(&storage), m_types(types), m_tick(tick)
+        {
+            for (ALKAHEST_COMPONENT_ID_TYPE type : m_types)
+                m_mask.set(type);
+        };
+
+        template<typename Fn>
+        void each(Fn&& fn)
+        {
+            for (auto& archetype : m_storage->getArchetypes())
+            {
+                if (!archetype->getMask().contains(m_mask))
+                    continue;
+
+                for (auto& chunk : archetype->getChunks())
+                    eachInChunk(fn, *archetype, chunk, std::index_sequence_for<Ts...>{});
+            }
+        };
+
+        // Chunks are already sized to stay within a few pages, so each
+        // matching chunk becomes one job. Without any workers it is just
+        // each().
+        template<typename Fn>
+        void parallelEach(Fn&& fn, size_t grain = 1)
+        {
+            if (JobSystem::getInstance()->getWorkerCount() == 0)
+            {
+                each(fn);
+                return;
+            }
+
+            std::vector<std::pair<Archetype*, Archetype::Chunk*>> chunks;
+            for (auto& archetype : m_storage->getArchetypes())
+            {
+                if (!archetype->getMask().contains(m_mask))
+                    continue;
+
+                for (auto& chunk : archetype->getChunks())
+                    chunks.push_back({ archetype.get(), &chunk });
+            }
+
+            JobSystem::getInstance()->parallelFor(chunks.size(), grain, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                    eachInChunk(fn, *chunks[i].first, *chunks[i].second, std::index_sequence_for<Ts...>{});
+            });
+        };
+#else
+        View(ALKAHEST_TICK_TYPE tick, ComponentArray<Ts>*... arrays) : m_arrays(arrays...), m_tick(tick) {};
+
+        template<typename Fn>
+        void each(Fn&& fn)
+        {
+            const ALKAHEST_ENTITY_ID_TYPE* ids = nullptr;
+            size_t count = smallest(ids);
+            eachInRange(fn, ids, 0, count);
+        };
+
+        // The driving set is split into ranges that start on a cache line
+        // boundary of its own dense arrays, so no two jobs write to the
+        // same line there. The other types are looked up through the
+        // sparse index, and their components may share lines across jobs.
+        // Without any workers it is just each().
+        template<typename Fn>
+        void parallelEach(Fn&& fn, size_t grain = 1024)
+        {
+            if (JobSystem::getInstance()->getWorkerCount() == 0)
+            {
+                each(fn);
+                return;
+            }
+
+            const ALKAHEST_ENTITY_ID_TYPE* ids = nullptr;
+            size_t count = smallest(ids);
+
+            size_t perLine = std::max({ elementsPerCacheLine(sizeof(ALKAHEST_ENTITY_ID_TYPE)),
+                elementsPerCacheLine(isTag<Ts> ? 1 : sizeof(Ts))... });
+            grain = (std::max<size_t>(grain, 1) + perLine - 1) / perLine * perLine;
+
+            JobSystem::getInstance()->parallelFor(count, grain, [&](size_t begin, size_t end) {
+                eachInRange(fn, ids, begin, end);
+            });
+        };
+#endif
+
+        // Filters can be chained, in which case every one of them must pass.
+        // Each type is checked against its own `since`.
+        template<typename T>
+        View& changed(ALKAHEST_TICK_TYPE since)
+        {
+            static_assert(!isTag<T>, "Tags don't track changes");
+            m_changedMask |= 1u << indexOf<T>();
+            m_since[indexOf<T>()] = since;
+            return *this;
+        };
+    private:
+        template<typename T, size_t I = 0>
+        static constexpr size_t indexOf()
+        {
+            static_assert(I < sizeof...(Ts), "Filtered component type is not part of the View");
+            if constexpr (std::is_same_v<T, std::tuple_element_t<I, std::tuple<Ts...>>>)
+                return I;
+            else
+                return indexOf<T, I + 1>();
+        };
+
+        // Whether the callback can write to the I-th component
+        template<typename Fn, size_t I>
+        static constexpr bool writes()
+        {
+            using Traits = CallbackArgs<std::decay_t<Fn>>;
+            if constexpr (isTag<std::tuple_element_t<I, std::tuple<Ts...>>>)
+            {
+                return false;
+            }
+            else if constexpr (!Traits::known)
+            {
+                return true;
+            }
+            else
+            {
+                using Args = typename Traits::Args;
+                constexpr size_t offset = std::tuple_size_v<Args> == sizeof...(Ts) + 1 ? 1 : 0;
+                using Arg = std::tuple_element_t<I + offset, Args>;
+                return std::is_lvalue_reference_v<Arg> && !std::is_const_v<std::remove_reference_t<Arg>>;
+            }
+        };
+
+        template<typename Fn>
+        static void invoke(Fn& fn, ALKAHEST_ENTITY_ID_TYPE id, Ts&... components)
+        {
+            if constexpr (std::is_invocable_v<Fn&, Entity, Ts&...>)
+                fn(Entity(id), components...);
+            else
+                fn(components...);
+        };
+
+        // Tags have no ticks, but are never filtered on either
+        bool passes(const ALKAHEST_TICK_TYPE* ticks, size_t row, size_t i) const
+        {
+            return !(m_changedMask & (1u << i)) || tickAtOrAfter(ticks[row], m_since[i]);
+        };
+
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+        // Every column in a chunk is contiguous, so rows are streamed
+        // straight out of the chunk memory
+        template<typename Fn, size_t... Is>
+        void eachInChunk(Fn& fn, const Archetype& archetype, const Archetype::Chunk& chunk,
+            std::index_sequence<Is...>)
+        {
+            const ALKAHEST_ENTITY_ID_TYPE* ids = archetype.entities(chunk);
+            std::tuple<Ts*...> columns{ columnOf<Ts>(archetype, chunk, m_types[Is])... };
+            std::array<ALKAHEST_TICK_TYPE*, sizeof...(Ts)> ticks{ isTag<Ts> ? nullptr : archetype.ticks(chunk, m_types[Is])... };
+
+            for (uint32_t row = 0; row < chunk.count; row++)
+            {
+                if (m_changedMask != 0 && !(passes(ticks[Is], row, Is) && ...))
+                    continue;
+
+                invoke(fn, ids[row], std::get<Is>(columns)[isTag<Ts> ? 0 : row]...);
+                ((writes<Fn, Is>() ? (void)(ticks[Is][row] = m_tick) : (void)0), ...);
+            }
+        };
+
+        template<typename T>
+        static T* columnOf(const Archetype& archetype, const Archetype::Chunk& chunk,
+            ALKAHEST_COMPONENT_ID_TYPE type)
+        {
+            if constexpr (isTag<T>)
+                return &tagInstance<T>();
+            else
+                return archetype.template column<T>(chunk, type);
+        };
+
+        ArchetypeStorage* m_storage;
+        std::array<ALKAHEST_COMPONENT_ID_TYPE, sizeof...(Ts)> m_types;
+        ALKAHEST_MASK_TYPE m_mask{};
+#else
+        // Drive the iteration from the smallest set, since no entity
+        // outside of it can match the view
+        size_t smallest(const ALKAHEST_ENTITY_ID_TYPE*& ids) const
+        {
+            size_t count = std::numeric_limits<size_t>::max();
+            ((std::get<ComponentArray<Ts>*>(m_arrays)->size() < count
+                ? (ids = std::get<ComponentArray<Ts>*>(m_arrays)->entities(),
+                    count = std::get<ComponentArray<Ts>*>(m_arrays)->size())
+                : count), ...);
+            return count;
+        };
+
+        template<typename Fn>
+        void eachInRange(Fn& fn, const ALKAHEST_ENTITY_ID_TYPE* ids, size_t begin, size_t end)
+        {
+            if constexpr (sizeof...(Ts) == 1 && (isTag<Ts> && ...))
+            {
+                for (size_t i = begin; i < end; i++)
+                    invoke(fn, ids[i], tagInstance<Ts>()...);
+            }
+            else if constexpr (sizeof...(Ts) == 1)
+            {
+                // Single component views walk the dense arrays directly,
+                // one contiguous page at a time
+                auto& data = std::get<0>(m_arrays)->data();
+                ALKAHEST_TICK_TYPE* ticks = std::get<0>(m_arrays)->ticks();
+                constexpr size_t pageSize = std::decay_t<decltype(data)>::pageSize;
+
+                size_t i = begin;
+                while (i < end)
+                {
+                    size_t offset = i % pageSize;
+                    size_t n = std::min(end - i, pageSize - offset);
+                    auto* page = data.page(i / pageSize) + offset;
+                    const ALKAHEST_ENTITY_ID_TYPE* pageIDs = ids + i;
+                    ALKAHEST_TICK_TYPE* pageTicks = ticks + i;
+
+                    for (size_t k = 0; k < n; k++)
+                    {
+                        if (m_changedMask != 0 && !passes(pageTicks, k, 0))
+                            continue;
+
+                        invoke(fn, pageIDs[k], page[k]);
+                        if constexpr (writes<Fn, 0>())
+                            pageTicks[k] = m_tick;
+                    }
+                    i += n;
+                }
+            }
+            else
+            {
+                eachInRange(fn, ids, begin, end, std::index_sequence_for<Ts...>{});
+            }
+        };
+
+        template<typename Fn, size_t... Is>
+        void eachInRange(Fn& fn, const ALKAHEST_ENTITY_ID_TYPE* ids, size_t begin, size_t end,
+            std::index_sequence<Is...>)
+        {
+            std::array<ALKAHEST_TICK_TYPE*, sizeof...(Ts)> ticks{ std::get<Is>(m_arrays)->ticks()... };
+
+            for (size_t i = begin; i < end; i++)
+            {
+                ALKAHEST_ENTITY_ID_TYPE id = ids[i];
+                std::array<SparseIndex::Index, sizeof...(Ts)> slots{ std::get<Is>(m_arrays)->find(id)... };
+                if (!((slots[Is] != SparseIndex::null) && ...))
+                    continue;
+                if (m_changedMask != 0 && !(passes(ticks[Is], slots[Is], Is) && ...))
+                    continue;
+
+                invoke(fn, id, std::get<Is>(m_arrays)->at(slots[Is])...);
+                ((writes<Fn, Is>() ? (void)(ticks[Is][slots[Is]] = m_tick) : (void)0), ...);
+            }
+        };
+
+        static constexpr size_t elementsPerCacheLine(size_t size)
+        {
+            size_t a = size, b = cacheLineSize;
+            while (b != 0)
+            {
+                size_t t = a % b;
+                a = b;
+                b = t;
+            }
+            return cacheLineSize / a;
+        };
+
+        static constexpr size_t cacheLineSize = 64;
+
+        std::tuple<ComponentArray<Ts>*...> m_arrays;
+#endif
+        ALKAHEST_TICK_TYPE m_tick;
+        std::array<ALKAHEST_TICK_TYPE, sizeof...(Ts)> m_since{};
+        uint32_t m_changedMask = 0;
+    };
+}
@@ -0,0 +1,616 @@
+#pragma once
+
+#include "../macros.h"
+#include "common.h"
+#include "managers/entitymanager.h"
+#include "managers/componentmanager.h"
+#include "managers/systemmanager.h"
+#include "managers/observermanager.h"
+#include "entity.h"
+#include "view.h"
+#include "commandbuffer.h"
+#include "prefab.h"
+#include "snapshot.h"
+
+// Engine Components and Systems
+#include "components/include.h"
+#include "systems/include.h"
+
+namespace Alkahest
+{
+    // An isolated ECS world with its own entities, component storage,
+    // systems, singletons and command buffers. Worlds only share the
+    // process-wide type indices, so separate worlds can be updated on
+    // separate threads at the same time (e.g. one per match on a server).
+    //
+    // The static ECSManager functions and the Entity helpers act on the
+    // calling thread's current world, which is the default world unless a
+    // World::Scope is active. Systems are always run with their own world
+    // as the current one.
+    class NOT_EXPORTED World
+    {
+    public:
+        World()
+        {
+            m_entityManager = std::make_unique<EntityManager>();
+            m_componentManager = std::make_unique<ComponentManager>();
+            m_systemManager = std::make_unique<SystemManager>(*this, *m_entityManager, *m_componentManager);
+            m_observerManager = std::make_unique<ObserverManager>(*m_entityManager);
+
+            // Register all engine-defined components and systems
+            registerComponent<Components::TransformComponent>();
+            registerComponent<Components::ParentComponent>();
+
+            auto transform = ALKAHEST_MASK_TYPE::bit(getComponentType<Components::TransformComponent>());
+            auto parent = ALKAHEST_MASK_TYPE::bit(getComponentType<Components::ParentComponent>());
+            registerSystem<Systems::TransformSystem>();
+            setSystemMask<Systems::TransformSystem>(transform, {});
+            // Transforms count as written, since the world matrices are
+            // derived from them: systems that read transforms and query
+            // getWorldMatrix() must not run while the matrices are rebuilt
+            setSystemAccess<Systems::TransformSystem>(transform | parent, transform);
+        };
+
+        World(const World&) = delete;
+        World& operator=(const World&) = delete;
+
+        // The calling thread's current world, or nullptr if no Scope is
+        // active on it
+        static World* current() { return currentSlot(); };
+
+        // Makes a world the calling thread's current world until the scope
+        // ends, e.g. around a server thread's simulation of one match
+        class NOT_EXPORTED Scope
+        {
+        public:
+            explicit Scope(World& world) : m_previous(currentSlot()) { currentSlot() = &world; };
+            ~Scope() { currentSlot() = m_previous; };
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+        private:
+            World* m_previous;
+        };
+
+        template<typename T>
+        void registerComponent()
+        {
+            m_componentManager->registerComponent<T>();
+        };
+
+        template<typename T>
+        void registerSystem()
+        {
+            m_systemManager->registerSystem<T>();
+        };
+
+        Entity createEntity()
+        {
+            return m_entityManager->createEntity();
+        };
+
+        // Creates `count` entities that all start out with a copy of the
+        // prefab's components
+        std::vector<Entity> spawnBatch(const Prefab& prefab, size_t count)
+        {
+            checkPrefab(prefab);
+
+            std::vector<Entity> entities;
+            m_entityManager->createEntities(count, entities);
+            instantiate(prefab, entities);
+            return entities;
+        };
+
+        bool isAlive(Entity e)
+        {
+            return m_entityManager->isAlive(e);
+        };
+
+        void destroyEntity(Entity e)
+        {
+            if (!m_entityManager->isAlive(e))
+                return;
+
+            ALKAHEST_MASK_TYPE mask = m_entityManager->getMask(e);
+            m_entityManager->destroyEntity(e);
+            m_componentManager->EntityDestroyed(e, mask);
+            m_systemManager->EntityDestroyed(e, mask);
+            m_observerManager->EntityDestroyed(e, mask);
+        };
+
+        template<typename T>
+        void addComponent(Entity e, T component)
+        {
+            if (!m_entityManager->isAlive(e))
+            {
+                logError("Attempting to add a component to a destroyed entity!");
+                throw AlkahestError{};
+            }
+
+            m_componentManager->addComponentToEntity(e, component);
+
+            ALKAHEST_COMPONENT_ID_TYPE type = m_componentManager->getComponentType<T>();
+            ALKAHEST_MASK_TYPE oldMask = m_entityManager->getMask(e);
+            if (oldMask.test(type))
+                return;
+
+            ALKAHEST_MASK_TYPE mask = oldMask;
+            mask.set(type);
+
+            m_entityManager->setMask(e, mask);
+            m_systemManager->EntityMaskChanged(e, oldMask, mask);
+            m_observerManager->EntityMaskChanged(e, oldMask, mask);
+        };
+
+        template<typename T>
+        void removeComponent(Entity e)
+        {
+            if (!m_entityManager->isAlive(e))
+                return;
+
+            m_componentManager->removeComponentFromEntity<T>(e);
+
+            ALKAHEST_COMPONENT_ID_TYPE type = m_componentManager->getComponentType<T>();
+            ALKAHEST_MASK_TYPE oldMask = m_entityManager->getMask(e);
+            if (!oldMask.test(type))
+                return;
+
+            ALKAHEST_MASK_TYPE mask = oldMask;
+            mask.reset(type);
+
+            m_entityManager->setMask(e, mask);
+            m_systemManager->EntityMaskChanged(e, oldMask, mask);
+            m_observerManager->EntityMaskChanged(e, oldMask, mask);
+        };
+
+        // Mutable access, which stamps the component as changed
+        template<typename T>
+        T& getComponent(Entity e)
+        {
+            return m_componentManager->getComponent<T>(e);
+        };
+
+        // Read-only access, which leaves the change tick alone
+        template<typename T>
+        const T& readComponent(Entity e)
+        {
+            return m_componentManager->readComponent<T>(e);
+        };
+
+        // Sorts T's storage by `compare(const T&, const T&)` and keeps each
+        // of Us in the same order, so iterating them afterwards walks the
+        // data front to back. Sorting counts as writing to every sorted
+        // type, and the order lasts until the types' entities change.
+        template<typename T, typename... Us, typename Compare>
+        void sort(Compare compare)
+        {
+            m_componentManager->sort<T, Us...>(compare);
+        };
+
+        // Starts a new change tick and returns it. Passing the result to
+        // View::changed() later yields the components changed since this
+        // call, e.g. for a renderer uploading only what moved.
+        ALKAHEST_TICK_TYPE advanceTick()
+        {
+            return m_componentManager->advanceTick();
+        };
+
+        ALKAHEST_TICK_TYPE getTick()
+        {
+            return m_componentManager->getTick();
+        };
+
+        // Singletons live in a table indexed by their own type index, so
+        // they don't use up component IDs
+        template<typename T>
+        void setSingleton(T value)
+        {
+            size_t type = TypeIndex<Singleton>::assign<T>();
+            if (type >= m_singletons.size())
+                m_singletons.resize(type + 1);
+            m_singletons[type] = std::make_shared<T>(std::move(value));
+        };
+
+        template<typename T>
+        T* tryGetSingleton()
+        {
+            size_t type = TypeIndex<Singleton>::get<T>();
+            if (type >= m_singletons.size())
+                return nullptr;
+            return static_cast<T*>(m_singletons[type].get());
+        };
+
+        template<typename T>
+        T& getSingleton()
+        {
+            T* singleton = tryGetSingleton<T>();
+            if (singleton == nullptr)
+            {
+                logError("Singleton component has not been set! Type: {}", typeid(T).name());
+                throw AlkahestError{};
+            }
+            return *singleton;
+        };
+
+        template<typename T>
+        void removeSingleton()
+        {
+            size_t type = TypeIndex<Singleton>::get<T>();
+            if (type < m_singletons.size())
+                m_singletons[type].reset();
+        };
+
+        template<typename T>
+        ALKAHEST_COMPONENT_ID_TYPE getComponentType()
+        {
+            return m_componentManager->getComponentType<T>();
+        };
+
+        // Builds a mask from a list of component types
+        template<typename... Cs>
+        ALKAHEST_MASK_TYPE getComponentMask()
+        {
+            return (ALKAHEST_MASK_TYPE{} | ... | ALKAHEST_MASK_TYPE::bit(getComponentType<Cs>()));
+        };
+
+        template<typename T>
+        void setSystemMask(ALKAHEST_MASK_TYPE mask, ALKAHEST_MASK_TYPE excluded = {})
+        {
+            m_systemManager->setMask<T>(mask, excluded);
+        };
+
+        template<typename T>
+        std::shared_ptr<T> getSystem()
+        {
+            return m_systemManager->getSystem<T>();
+        };
+
+        template<typename T>
+        void setSystemAccess(ALKAHEST_MASK_TYPE reads, ALKAHEST_MASK_TYPE writes)
+        {
+            m_systemManager->setAccess<T>(reads, writes);
+        };
+
+        // Observers are handed the entities whose T was added, removed or
+        // changed as one batch per flush, e.g. for a renderer keeping its
+        // draw lists in sync. Removal batches may name entities that are
+        // already destroyed, or whose addition was never reported because
+        // the component was removed again before the flush. Change batches
+        // also include newly added components.
+        template<typename T>
+        void onAdd(ObserverCallback fn)
+        {
+            m_observerManager->onAdd(getComponentType<T>(), std::move(fn));
+        };
+
+        template<typename T>
+        void onRemove(ObserverCallback fn)
+        {
+            m_observerManager->onRemove(getComponentType<T>(), std::move(fn));
+        };
+
+        template<typename T>
+        void onChange(ObserverCallback fn)
+        {
+            static_assert(!isTag<T>, "Tags don't track changes");
+
+            auto collect = [this](ALKAHEST_TICK_TYPE since, std::vector<Entity>& out) {
+                view<T>().template changed<T>(since).each([&](Entity e, const T&) { out.push_back(e); });
+            };
+            m_observerManager->onChange(getComponentType<T>(), collect, std::move(fn), advanceTick());
+        };
+
+        void update()
+        {
+            m_systemManager->update();
+            flushCommands();
+            flushObservers();
+        };
+
+        // Delivers the batches gathered since the last flush to the
+        // observers, on the calling thread. Called at the end of update(),
+        // after the commands have been played back.
+        void flushObservers()
+        {
+            m_observerManager->flush(advanceTick());
+        };
+
+        // The calling thread's command buffer for this world. Each
+        // thread's buffer is created on first use and kept for the
+        // lifetime of the world.
+        CommandBuffer& commands()
+        {
+            // The last buffer used is cached per thread. It is keyed by the
+            // world's ID rather than its address, which a later world may
+            // reuse.
+            thread_local uint64_t cachedWorld = 0;
+            thread_local CommandBuffer* cachedBuffer = nullptr;
+            if (cachedWorld == m_id)
+                return *cachedBuffer;
+
+            std::lock_guard<std::mutex> lock(m_commandMutex);
+            CommandBuffer*& buffer = m_threadBuffers[std::this_thread::get_id()];
+            if (buffer == nullptr)
+            {
+                m_commandBuffers.push_back(std::make_unique<CommandBuffer>(*this));
+                buffer = m_commandBuffers.back().get();
+            }
+
+            cachedWorld = m_id;
+            cachedBuffer = buffer;
+            return *buffer;
+        };
+
+        // Plays back every thread's buffer: prefab spawns first, then one
+        // component type at a time, then destroys the queued entities.
+        // Must only be called while no system is recording.
+        //
+        // Playback is not atomic. If a command throws, the changes played
+        // back before it are kept, every buffer is cleared so the rest are
+        // dropped, and the exception is passed on.
+        void flushCommands()
+        {
+            std::lock_guard<std::mutex> lock(m_commandMutex);
+            m_entityManager->commitReserved();
+
+            try
+            {
+                playbackCommands();
+            }
+            catch (...)
+            {
+                for (auto const& buffer : m_commandBuffers)
+                    buffer->clear();
+                throw;
+            }
+        };
+
+        // Captures every entity and component in a buffer that can be
+        // saved to a file or kept in memory, and restored later. Only
+        // trivially copyable components can be captured, and singletons
+        // are not included. Neither may be called during update().
+        Snapshot snapshot()
+        {
+            m_entityManager->commitReserved();
+
+            Snapshot snapshot;
+            snapshot.write(Snapshot::Header::current());
+            m_componentManager->save(snapshot);
+            m_entityManager->save(snapshot);
+            return snapshot;
+        };
+
+        // Replaces the whole world with the snapshot's. Commands recorded
+        // against the old world are dropped, and every restored component
+        // reads as changed.
+        void restore(const Snapshot& snapshot)
+        {
+            // Every block is read and checked before anything is replaced,
+            // so a rejected snapshot leaves the world as it was
+            Snapshot::Reader in(snapshot);
+            in.checkHeader();
+            ComponentManager::Loaded components = m_componentManager->load(in);
+            EntityManager::Loaded entities = m_entityManager->load(in);
+
+            {
+                std::lock_guard<std::mutex> lock(m_commandMutex);
+                for (auto const& buffer : m_commandBuffers)
+                    buffer->clear();
+            }
+
+            // Observers see every old component removed and every restored
+            // one added
+            m_entityManager->forEachWithMask([&](Entity e, ALKAHEST_MASK_TYPE mask) {
+                m_observerManager->EntityDestroyed(e, mask);
+            });
+
+            m_componentManager->restore(std::move(components));
+            m_entityManager->restore(std::move(entities));
+            m_systemManager->WorldRestored();
+
+            m_entityManager->forEachWithMask([&](Entity e, ALKAHEST_MASK_TYPE mask) {
+                m_observerManager->EntityMaskChanged(e, {}, mask);
+            });
+        };
+
+        template<typename... Ts>
+        View<Ts...> view()
+        {
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+            return View<Ts...>(m_componentManager->getArchetypeStorage(),
+                { m_componentManager->getComponentType<Ts>()... }, m_componentManager->getTick());
+#else
+            return View<Ts...>(m_componentManager->getTick(), m_componentManager->getComponentArray<Ts>()...);
+#endif
+        };
+    private:
+        friend class CommandBuffer;
+        template<typename T> friend class CommandBatch;
+
+        // Type index family for singleton components
+        struct Singleton;
+
+        // The calling thread's current world and the source of world IDs.
+        // Both are defined in ecsmanager.cpp and exported, so the engine
+        // and a client linking it as a shared library share them.
+        static API World*& currentSlot();
+        static API uint64_t nextID();
+
+        // Used by command buffers, which may create entities from several
+        // threads while systems are reading the entity arrays. Fresh
+        // indices are committed by the next flushCommands().
+        Entity reserveEntity()
+        {
+            return reserveEntities(1).front();
+        };
+
+        std::vector<Entity> reserveEntities(size_t count)
+        {
+            std::vector<Entity> entities;
+            std::lock_guard<std::mutex> lock(m_reserveMutex);
+            m_entityManager->reserveEntities(count, entities);
+            return entities;
+        };
+
+        // Expects m_commandMutex to be held
+        void playbackCommands()
+        {
+            for (auto const& buffer : m_commandBuffers)
+            {
+                for (const CommandBuffer::Spawn& spawn : buffer->m_spawns)
+                    instantiate(*spawn.prefab, spawn.entities);
+                buffer->m_spawns.clear();
+            }
+
+            size_t typeCount = 0;
+            for (auto const& buffer : m_commandBuffers)
+            {
+                if (!buffer->empty())
+                    typeCount = std::max(typeCount, buffer->m_batches.size());
+            }
+
+            for (size_t type = 0; type < typeCount; type++)
+            {
+                for (auto const& buffer : m_commandBuffers)
+                {
+                    if (!buffer->empty() && type < buffer->m_batches.size() && buffer->m_batches[type])
+                        buffer->m_batches[type]->playback(*this);
+                }
+            }
+
+            for (auto const& buffer : m_commandBuffers)
+            {
+                for (Entity e : buffer->m_destroyed)
+                    destroyEntity(e);
+
+                buffer->m_destroyed.clear();
+                buffer->m_empty = true;
+            }
+        };
+
+        // Gives entities that don't have any components yet the prefab's
+        // components. Each storage is filled in a single pass and system
+        // membership is updated once for the whole batch.
+        void instantiate(const Prefab& prefab, const std::vector<Entity>& entities)
+        {
+            ALKAHEST_MASK_TYPE mask = prefab.getMask();
+            if (mask.none() || entities.empty())
+                return;
+
+            checkPrefab(prefab);
+
+            // Entities reserved by a command buffer may have been destroyed
+            // or given components before playback, and are left alone
+            auto fresh = [this](Entity e) {
+                return m_entityManager->isAlive(e) && m_entityManager->getMask(e).none();
+            };
+            std::vector<Entity> filtered;
+            const std::vector<Entity>* batch = &entities;
+            if (!std::all_of(entities.begin(), entities.end(), fresh))
+            {
+                std::copy_if(entities.begin(), entities.end(), std::back_inserter(filtered), fresh);
+                batch = &filtered;
+            }
+
+            for (Entity e : *batch)
+                m_entityManager->setMask(e, mask);
+            m_componentManager->insertBatch(prefab, batch->data(), batch->size());
+            m_systemManager->EntitiesCreated(*batch, mask);
+            m_observerManager->EntitiesCreated(*batch, mask);
+        };
+
+        void checkPrefab(const Prefab& prefab)
+        {
+            if (!m_componentManager->isRegistered(prefab.getMask()))
+            {
+                logError("Prefab contains a component that has not been registered!");
+                throw AlkahestError{};
+            }
+        };
+    private:
+        const uint64_t m_id = nextID();
+
+        std::unique_ptr<EntityManager> m_entityManager;
+        std::unique_ptr<ComponentManager> m_componentManager;
+        std::unique_ptr<SystemManager> m_systemManager;
+        std::unique_ptr<ObserverManager> m_observerManager;
+
+        std::vector<std::shared_ptr<void>> m_singletons{};
+
+        std::vector<std::unique_ptr<CommandBuffer>> m_commandBuffers{};
+        std::unordered_map<std::thread::id, CommandBuffer*> m_threadBuffers{};
+        std::mutex m_commandMutex{};
+        std::mutex m_reserveMutex{};
+    };
+
+    template<typename... Ts>
+    View<Ts...> System::view()
+    {
+        return m_world->view<Ts...>();
+    }
+
+    template<typename T>
+    const T& System::readComponent(Entity e)
+    {
+        return m_world->readComponent<T>(e);
+    }
+
+    inline CommandBuffer& System::commands()
+    {
+        return m_world->commands();
+    }
+
+    inline Entity CommandBuffer::createEntity()
+    {
+        return m_world.reserveEntity();
+    }
+
+    inline std::vector<Entity> CommandBuffer::spawnBatch(const Prefab& prefab, size_t count)
+    {
+        std::vector<Entity> entities = m_world.reserveEntities(count);
+        m_spawns.push_back({ &prefab, entities });
+        m_empty = false;
+        return entities;
+    }
+
+    // Commands aimed at an entity that was destroyed before playback are
+    // dropped
+    template<typename T>
+    void CommandBatch<T>::playback(World& world)
+    {
+        for (Command& command : m_commands)
+        {
+            if (command.component)
+            {
+                if (world.isAlive(command.entity))
+                    world.addComponent<T>(command.entity, std::move(*command.component));
+            }
+            else
+            {
+                world.removeComponent<T>(command.entity);
+            }
+        }
+        m_commands.clear();
+    }
+
+    // Systems run with their own world as the current one, so ECSManager
+    // calls made from process() reach the right world on any worker
+    inline void SystemManager::runScheduled(size_t node, JobCounter& counter)
+    {
+        System* system = m_schedule[node].system;
+        World::Scope scope(m_world);
+
+        system->m_lastRunTick = system->m_runTick;
+        system->m_runTick = m_componentManager.advanceTick();
+        system->update();
+
+        for (size_t dependent : m_schedule[node].dependents)
+        {
+            if (m_schedule[dependent].pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                JobSystem::getInstance()->submit(
+                    [this, dependent, &counter]{ runScheduled(dependent, counter); }, &counter);
+            }
+        }
+    }
+}
@@ -37,7 +37,8 @@ namespace Alkahest
         d->registerCallback(EventType::WindowResize, [](Event* e){ logTrace(e->toString()); });
         d->registerCallback(EventType::WindowClose, [](Event* e){ logTrace(e->toString()); });
 
-        // Handle window close
+        // Handle window close. Stopping only sets a flag, so it is done
+        // right away, which also works for clients that override run()
         d->registerCallback(EventType::WindowClose, [app](Event* e){ app->stop(); });
     }
 
@@ -85,13 +86,17 @@ namespace Alkahest
         while (!m_shouldStop)
         {
             m_window->onUpdate();
+            m_dispatcher->runMainThreadCallbacks();
+            ECSManager::update();
             update();
         }
     }
 
     void Application::onEvent(Event* e)
     {
+        // The window's event only lives for the duration of the call, so
+        // the queue keeps a copy
         EventQueue* eq = EventQueue::getInstance();
-        eq->push(e);
+        eq->push(*e);
     };
 }
@@ -31,11 +31,12 @@ namespace Alkahest
         void init();
         virtual void run();
         virtual void update() {};
+        // Safe to call from any thread, e.g. an event callback
         void stop() { m_shouldStop = true; };
     protected:
         std::unique_ptr<IWindow> m_window;
         std::unique_ptr<EventDispatcher> m_dispatcher;
-        bool m_shouldStop = false;
+        std::atomic<bool> m_shouldStop{false};
 
         Ref<Camera> m_mainCamera;
 
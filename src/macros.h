@@ -35,6 +35,17 @@
     #define BIT(x) (1 << x)
 #endif
 
+// SIMD code paths are selected at compile time from the target's
+// instruction set. Define ALKAHEST_NO_SIMD to force the scalar paths.
+#if !defined(ALKAHEST_NO_SIMD)
+    #if defined(__AVX__)
+        #define ALKAHEST_SIMD_AVX
+    #endif
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define ALKAHEST_SIMD_SSE2
+    #endif
+#endif
+
 namespace Alkahest
 {
     template<typename T>
@@ -13,13 +13,20 @@
 #include <functional>
 #include <vector>
 #include <array>
+#include <optional>
+#include <limits>
 #include <queue>
 #include <deque>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <algorithm>
+#include <numeric>
 #include <thread>
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <shared_mutex>
 #include <utility>
 #include <typeinfo>
+#include <exception>
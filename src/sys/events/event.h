@@ -30,13 +30,19 @@ namespace Alkahest
         None = 0,
         WindowResize, WindowClose,
         KeyDown, KeyUp,
-        MouseButtonDown, MouseButtonUp, MouseMove, MouseScroll 
+        MouseButtonDown, MouseButtonUp, MouseMove, MouseScroll,
+
+        // Number of event types, used to size per-type tables
+        Count
     };
 
     // Macros to easily set up new Event types
     #define SETUP_EVENT_TYPE(type) static EventType getStaticType() { return EventType::type; };\
                                     virtual EventType getEventType() const override { return getStaticType(); }\
-                                    virtual const char *getName() const override { return #type; }
+                                    virtual const char *getName() const override { return #type; }\
+                                    virtual size_t getSize() const override { return sizeof(*this); }\
+                                    virtual Event* copyTo(void* buffer) const override\
+                                        { return new (buffer) std::remove_const_t<std::remove_reference_t<decltype(*this)>>(*this); }
     #define SETUP_EVENT_FLAGS(flags) virtual int getCategoryFlags() const override { return flags; }
 
     class API Event
@@ -48,6 +54,16 @@ namespace Alkahest
         virtual int getCategoryFlags() const = 0;
         virtual const char *getName() const = 0;
         virtual std::string toString() const = 0;
+
+        // Copies the event into `buffer`, which must hold getSize() bytes,
+        // so queues can store events by value
+        virtual size_t getSize() const = 0;
+        virtual Event* copyTo(void* buffer) const = 0;
+
+        // Folds the next event of the same type into this one, so a burst
+        // can be dispatched as a single event. Returns false for types
+        // that can't be merged.
+        virtual bool coalesce(const Event&) { return false; };
     protected:
         bool m_Handled = false;
     };
@@ -1,12 +1,12 @@
 #include "eventqueue.h"
 #include "../log/log.h"
+#include "../jobs/jobsystem.h"
 
 namespace Alkahest
 {
     EventQueue* EventQueue::m_pInstance = nullptr;
     EventDispatcher* EventDispatcher::m_pInstance = nullptr;
 
-    static std::mutex eventQueueMutex;
     static std::mutex eventDispatcherMutex;
 
     EventQueue *EventQueue::getInstance()
@@ -18,70 +18,126 @@ namespace Alkahest
 
     EventQueue::EventQueue()
     {
-        m_head = m_tail = nullptr;
-        m_size = 0;
+        m_slots = std::make_unique<Slot[]>(capacity);
+        for (size_t i = 0; i < capacity; i++)
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
     }
 
     EventQueue::~EventQueue()
     {
-        // Acquire lock to ensure atomicity
-        std::lock_guard<std::mutex> l(eventQueueMutex);
+        // destroy any events that were never dispatched
+        while (peek() != nullptr)
+            pop();
+    }
 
-        // loop through queue to delete any remaining pointers
-        while (m_head != nullptr)
+    bool EventQueue::push(const Event& e)
+    {
+        if (e.getSize() > ALKAHEST_EVENT_SLOT_SIZE)
         {
-            EventQueueItem* h = m_head;
-            m_head = h->next;
-            delete h;
+            logError("Event does not fit in an event queue slot! Event: {}", e.getName());
+            return false;
         }
-        m_tail = nullptr;
+
+        Slot* slot = claim();
+        if (slot == nullptr)
+            return false;
+        publish(slot, e.copyTo(slot->storage));
+        return true;
     }
 
-    void EventQueue::push(Event* e)
+    EventQueue::Slot* EventQueue::claim()
     {
-        // Acquire lock to ensure atomicity
-        std::lock_guard<std::mutex> l(eventQueueMutex);
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Slot& slot = m_slots[pos & (capacity - 1)];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+            if (difference == 0)
+            {
+                // The slot is free for this position, try to claim it
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    return &slot;
+            }
+            else if (difference < 0)
+            {
+                // The slot still holds the event from one lap ago
+                if (m_dropped.fetch_add(1, std::memory_order_relaxed) == 0)
+                    logWarning("Event queue is full, dropping events");
+                return nullptr;
+            }
+            else
+            {
+                // Another producer claimed this position first
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
 
-        // Create new EventQueueItem on heap
-        EventQueueItem* i = new EventQueueItem(e, nullptr);
+    void EventQueue::publish(Slot* slot, Event* e)
+    {
+        size_t pos = slot->sequence.load(std::memory_order_relaxed);
+        slot->event = e;
+        slot->pushedAt = Clock::now();
+        slot->sequence.store(pos + 1, std::memory_order_release);
 
-        // empty queue edge case
-        if (m_head == nullptr)
+        // Pairs with the fence in wait(): either the consumer sees this
+        // event before sleeping, or this sees the consumer asleep
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed))
         {
-            m_head = i;
-            m_tail = i;
-            m_size = 1;
-            return;
+            std::lock_guard<std::mutex> l(m_waitMutex);
+            m_waitCV.notify_one();
         }
+    }
 
-        // add item as new tail
-        m_tail->next = i;
-        m_tail = i;
-        m_size++;
+    Event* EventQueue::peek(Clock::time_point* pushedAt)
+    {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[pos & (capacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+            return nullptr;
+        if (pushedAt != nullptr)
+            *pushedAt = slot.pushedAt;
+        return slot.event;
     }
 
-    Event* EventQueue::pop()
+    void EventQueue::pop()
     {
-        // Acquire lock to ensure atomicity
-        std::lock_guard<std::mutex> l(eventQueueMutex);
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[pos & (capacity - 1)];
+        slot.event->~Event();
 
-        // Save head pointer for deletion after pop
-        EventQueueItem* h = m_head;
-        Event* e = h->event;
-        m_head = h->next;
-        m_size--;
-        delete h;  // delete here to close loop from push()
-        return e;
+        // Hand the slot back to producers for the next lap
+        slot.sequence.store(pos + capacity, std::memory_order_release);
+        m_dequeuePos.store(pos + 1, std::memory_order_relaxed);
     }
 
     unsigned int EventQueue::count() const
     {
-        // Using std::shared_lock to allow non-blocking read-only access
-        std::lock_guard<std::mutex> l(eventQueueMutex);
-
-        return m_size;
+        size_t enqueued = m_enqueuePos.load(std::memory_order_relaxed);
+        size_t dequeued = m_dequeuePos.load(std::memory_order_relaxed);
+        return static_cast<unsigned int>(enqueued > dequeued ? enqueued - dequeued : 0);
     };
 
+    void EventQueue::wait()
+    {
+        std::unique_lock<std::mutex> l(m_waitMutex);
+        m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_waitCV.wait(l, [this]{ return m_woken || peek() != nullptr; });
+        m_sleeping.store(false, std::memory_order_relaxed);
+        m_woken = false;
+    }
+
+    void EventQueue::wake()
+    {
+        std::lock_guard<std::mutex> l(m_waitMutex);
+        m_woken = true;
+        m_waitCV.notify_one();
+    }
+
     EventDispatcher *EventDispatcher::getInstance()
     {
         if (m_pInstance == nullptr)
@@ -92,6 +148,11 @@ namespace Alkahest
     EventDispatcher::EventDispatcher()
     {
         m_eqInstance = EventQueue::getInstance();
+
+        // high frequency events where only the sum or the latest value matters
+        setCoalescing(EventType::MouseMove, true);
+        setCoalescing(EventType::MouseScroll, true);
+        setCoalescing(EventType::WindowResize, true);
     }
 
     EventDispatcher::~EventDispatcher()
@@ -105,57 +166,177 @@ namespace Alkahest
 
     void EventDispatcher::run()
     {
-        while (!m_shouldStop)
+        while (!m_shouldStop.load(std::memory_order_acquire))
         {
-            processTick();
+            // Park until something is pushed instead of spinning on
+            // an empty queue
+            if (processTick() == 0)
+                m_eqInstance->wait();
         }
     }
 
-    bool EventDispatcher::sortCallbacksByPriority(const CallbackEntry &cb1, const CallbackEntry &cb2)
+    void EventDispatcher::stop()
     {
-        return (cb1.priority < cb2.priority);
+        m_shouldStop.store(true, std::memory_order_release);
+        m_eqInstance->wake();
     }
 
-    void EventDispatcher::processTick()
+    EventStats EventDispatcher::getStats() const
     {
-        if (m_eqInstance->count() == 0)
-            return; // don't process if there are no events
+        uint64_t dispatched = m_dispatched.load(std::memory_order_relaxed);
+        uint64_t total = m_totalLatencyNs.load(std::memory_order_relaxed);
+        return {
+            dispatched,
+            m_coalesced.load(std::memory_order_relaxed),
+            m_batches.load(std::memory_order_relaxed),
+            dispatched > 0 ? static_cast<double>(total) / dispatched / 1000.0 : 0.0,
+            static_cast<double>(m_maxLatencyNs.load(std::memory_order_relaxed)) / 1000.0
+        };
+    }
 
-        logTrace("Events waiting in queue: {}", m_eqInstance->count());
-        
-        // Acquire lock to ensure atomicity
-        std::unique_lock<std::mutex> l(eventDispatcherMutex);
+    void EventDispatcher::resetStats()
+    {
+        m_dispatched.store(0, std::memory_order_relaxed);
+        m_coalesced.store(0, std::memory_order_relaxed);
+        m_batches.store(0, std::memory_order_relaxed);
+        m_totalLatencyNs.store(0, std::memory_order_relaxed);
+        m_maxLatencyNs.store(0, std::memory_order_relaxed);
+    }
+
+    void EventDispatcher::setCoalescing(EventType t, bool enabled)
+    {
+        m_coalescing[static_cast<size_t>(t)].store(enabled, std::memory_order_relaxed);
+    }
+
+    void EventDispatcher::refreshDispatchTables()
+    {
+        uint64_t version = m_callbacksVersion.load(std::memory_order_acquire);
+        if (version == m_dispatchVersion)
+            return;
+
+        std::lock_guard<std::mutex> l(eventDispatcherMutex);
+        m_dispatchTables = m_callbacks;
+        m_dispatchVersion = m_callbacksVersion.load(std::memory_order_relaxed);
+    }
+
+    size_t EventDispatcher::processTick()
+    {
+        // Only the events already queued are part of this batch, so
+        // producers that keep pushing can't hold the batch open forever
+        size_t pending = m_eqInstance->count();
+        if (pending == 0)
+            return 0; // don't process if there are no events
 
-        // grab event
-        Event* e = m_eqInstance->pop();
+        logTrace("Events waiting in queue: {}", pending);
+        refreshDispatchTables();
 
-        // create vector of callbacks that should be called
-        std::vector<CallbackEntry> valid_callbacks;
-        for (int i = 0; i < m_callbacks.size(); i++)
+        // merged events are built up outside of the queue, so their slots
+        // can be handed back to producers right away
+        alignas(std::max_align_t) std::byte merged[ALKAHEST_EVENT_SLOT_SIZE];
+
+        size_t processed = 0;
+        size_t coalesced = 0;
+        uint64_t totalLatency = 0;
+        uint64_t maxLatency = 0;
+        EventQueue::Clock::time_point pushedAt;
+        Event* e;
+        while (processed < pending && (e = m_eqInstance->peek(&pushedAt)) != nullptr)
         {
-            if (m_callbacks[i].t == e->getEventType())
+            uint64_t latency = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                EventQueue::Clock::now() - pushedAt).count());
+            totalLatency += latency;
+            maxLatency = std::max(maxLatency, latency);
+
+            size_t type = static_cast<size_t>(e->getEventType());
+            bool owned = false;
+            if (m_coalescing[type].load(std::memory_order_relaxed))
             {
-                valid_callbacks.push_back(m_callbacks[i]);
+                e = e->copyTo(merged);
+                m_eqInstance->pop();
+                processed++;
+                owned = true;
+
+                Event* next;
+                while (processed < pending && (next = m_eqInstance->peek()) != nullptr
+                    && next->getEventType() == e->getEventType() && e->coalesce(*next))
+                {
+                    m_eqInstance->pop();
+                    processed++;
+                    coalesced++;
+                }
+            }
+
+            const std::shared_ptr<const CallbackTable>& callbacks = m_dispatchTables[type];
+            if (callbacks)
+            {
+                // copied at most once per event, and only if some callback
+                // runs on another thread
+                std::shared_ptr<EventCopy> copy;
+                for (const CallbackEntry& entry : *callbacks)
+                {
+                    // without any workers, nothing would ever run the jobs
+                    if (entry.affinity == CallbackAffinity::Dispatcher
+                        || (entry.affinity == CallbackAffinity::Worker && JobSystem::getInstance()->getWorkerCount() == 0))
+                    {
+                        entry.cb(e);
+                        continue;
+                    }
+
+                    if (!copy)
+                        copy = std::make_shared<EventCopy>(*e);
+                    DeferredCallback deferred{ callbacks, &entry, copy };
+
+                    if (entry.affinity == CallbackAffinity::Worker)
+                    {
+                        JobSystem::getInstance()->submit([deferred]{ deferred.entry->cb(deferred.event->get()); });
+                    }
+                    else
+                    {
+                        std::lock_guard<std::mutex> l(m_mainThreadMutex);
+                        m_mainThreadCallbacks.push_back(std::move(deferred));
+                    }
+                }
+            }
+
+            if (owned)
+            {
+                e->~Event();
+            }
+            else
+            {
+                // the event stays in its queue slot until dispatched
+                m_eqInstance->pop();
+                processed++;
             }
         }
-        // sort callbacks by priority
-        std::sort(valid_callbacks.begin(), valid_callbacks.end(), sortCallbacksByPriority);
 
-        // Unlocking here because we are no longer in
-        // dangerous territory, just calling some CBs
-        l.unlock();
+        m_dispatched.fetch_add(processed - coalesced, std::memory_order_relaxed);
+        m_coalesced.fetch_add(coalesced, std::memory_order_relaxed);
+        m_batches.fetch_add(1, std::memory_order_relaxed);
+        m_totalLatencyNs.fetch_add(totalLatency, std::memory_order_relaxed);
+        uint64_t previousMax = m_maxLatencyNs.load(std::memory_order_relaxed);
+        while (maxLatency > previousMax
+            && !m_maxLatencyNs.compare_exchange_weak(previousMax, maxLatency, std::memory_order_relaxed));
+
+        return processed;
+    }
 
-        for(int i = 0; i < valid_callbacks.size(); i++)
+    size_t EventDispatcher::runMainThreadCallbacks()
+    {
+        // swap the queue out so callbacks can be queued while these run
+        std::vector<DeferredCallback> callbacks;
         {
-            // This is a very dirty way of handling callbacks, as the
-            // function should NOT be called in this thread for
-            // potential of blocking the entire event queue, but
-            // it'll have to work for now
-            valid_callbacks[i].cb(e);
+            std::lock_guard<std::mutex> l(m_mainThreadMutex);
+            callbacks.swap(m_mainThreadCallbacks);
         }
+
+        for (const DeferredCallback& deferred : callbacks)
+            deferred.entry->cb(deferred.event->get());
+        return callbacks.size();
     }
 
-    void EventDispatcher::registerCallback(EventType t, std::function<void(Event*)> cb, int priority)
+    void EventDispatcher::registerCallback(EventType t, std::function<void(Event*)> cb, int priority,
+        CallbackAffinity affinity)
     {
         // Acquire lock to ensure atomicity
         std::lock_guard<std::mutex> l(eventDispatcherMutex);
@@ -165,6 +346,15 @@ namespace Alkahest
         // This leaves it up to other processes to not register
         // the same callback more than once to guard against
         // unexpected behavior
-        m_callbacks.push_back(CallbackEntry(t, cb, priority));
+        std::shared_ptr<const CallbackTable>& table = m_callbacks[static_cast<size_t>(t)];
+        auto updated = table ? std::make_shared<CallbackTable>(*table) : std::make_shared<CallbackTable>();
+
+        // insert after every callback with the same or a lower priority
+        auto position = std::upper_bound(updated->begin(), updated->end(), priority,
+            [](int p, const CallbackEntry& entry) { return p < entry.priority; });
+        updated->insert(position, CallbackEntry(cb, priority, affinity));
+
+        table = std::move(updated);
+        m_callbacksVersion.fetch_add(1, std::memory_order_release);
     }
 }
\ No newline at end of file
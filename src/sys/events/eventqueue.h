@@ -3,15 +3,24 @@
 #include "../../macros.h"
 #include "event.h"
 
+// Number of events the queue can hold before pushes are dropped. Must
+// be a power of two.
+#ifndef ALKAHEST_EVENT_QUEUE_CAPACITY
+#define ALKAHEST_EVENT_QUEUE_CAPACITY 4096
+#endif
+
+// Bytes of storage in each queue slot, which bounds the size of an event
+#ifndef ALKAHEST_EVENT_SLOT_SIZE
+#define ALKAHEST_EVENT_SLOT_SIZE 48
+#endif
+
 namespace Alkahest
 {
-    struct EventQueueItem
-    {
-        Event* event;
-        EventQueueItem* next;
-        EventQueueItem(Event* e, EventQueueItem* n): event(e), next(n) {};
-    };
-
+    // Bounded multi-producer/single-consumer ring of fixed-size slots.
+    // Events are copied into the slots by value, so pushing never
+    // allocates, and producers only contend on a single atomic counter.
+    // Each slot carries a sequence number that tells producers when it is
+    // free and the consumer when its event has been fully written.
     class API EventQueue
     {
     public:
@@ -21,16 +30,100 @@ namespace Alkahest
 
         ~EventQueue();
 
-        void push(Event* e);
-        Event* pop();
+        // Copies the event into the queue. Returns false, and drops the
+        // event, if the queue is full.
+        bool push(const Event& e);
+
+        template<typename T, typename... Args>
+        bool emplace(Args&&... args)
+        {
+            static_assert(sizeof(T) <= ALKAHEST_EVENT_SLOT_SIZE, "Event does not fit in an event queue slot");
+            static_assert(alignof(T) <= alignof(std::max_align_t), "Event is over-aligned for an event queue slot");
+
+            Slot* slot = claim();
+            if (slot == nullptr)
+                return false;
+            publish(slot, new (slot->storage) T(std::forward<Args>(args)...));
+            return true;
+        };
+
+        using Clock = std::chrono::steady_clock;
+
+        // The oldest event, or nullptr if the queue is empty. Only the
+        // consumer may call peek(), pop() and wait(). `pushedAt` receives
+        // the time the event was pushed.
+        Event* peek(Clock::time_point* pushedAt = nullptr);
+
+        // Destroys the oldest event and frees its slot
+        void pop();
+
+        // Approximate while producers are pushing
         unsigned int count() const;
+
+        // Blocks until an event is available or wake() is called.
+        // Producers only touch the mutex while the consumer is asleep.
+        void wait();
+        void wake();
+
+        // Events dropped so far because the queue was full
+        size_t getDroppedCount() const { return m_dropped.load(std::memory_order_relaxed); };
     private:
         EventQueue();
 
+        struct Slot
+        {
+            std::atomic<size_t> sequence;
+            Event* event;
+            Clock::time_point pushedAt;
+            alignas(std::max_align_t) std::byte storage[ALKAHEST_EVENT_SLOT_SIZE];
+        };
+
+        static constexpr size_t capacity = ALKAHEST_EVENT_QUEUE_CAPACITY;
+        static_assert((capacity & (capacity - 1)) == 0, "ALKAHEST_EVENT_QUEUE_CAPACITY must be a power of two");
+
+        // Reserves the next free slot for a producer, or returns nullptr
+        // if the queue is full
+        Slot* claim();
+        void publish(Slot* slot, Event* e);
+
         static EventQueue* m_pInstance;
-        EventQueueItem* m_head;
-        EventQueueItem* m_tail;
-        unsigned int m_size;
+        std::unique_ptr<Slot[]> m_slots;
+        alignas(64) std::atomic<size_t> m_enqueuePos{0};
+        alignas(64) std::atomic<size_t> m_dequeuePos{0};
+        std::atomic<size_t> m_dropped{0};
+
+        std::mutex m_waitMutex;
+        std::condition_variable m_waitCV;
+        std::atomic<bool> m_sleeping{false};
+        bool m_woken = false;
+    };
+
+    // Running totals kept by the dispatcher. Events merged into another
+    // are counted as coalesced rather than dispatched. Latency is measured
+    // from the push of an event (the first of a merged run) to the start
+    // of its dispatch.
+    struct API EventStats
+    {
+        uint64_t dispatched;
+        uint64_t coalesced;
+        uint64_t batches;
+        double meanLatencyUs;
+        double maxLatencyUs;
+    };
+
+    // Where a callback runs. Dispatcher callbacks run inline and should
+    // be quick, Worker callbacks are submitted to the JobSystem, and
+    // MainThread callbacks are queued until the main loop calls
+    // EventDispatcher::runMainThreadCallbacks().
+    //
+    // Worker callbacks run on whichever thread picks the job up. That
+    // includes the main thread while it waits on the JobSystem in the
+    // middle of an ECS update, so they must not touch the ECS. Hand such
+    // work to a MainThread callback instead.
+    enum class CallbackAffinity {
+        Dispatcher,
+        MainThread,
+        Worker
     };
 
     class NOT_EXPORTED EventDispatcher
@@ -40,28 +133,104 @@ namespace Alkahest
 
         ~EventDispatcher();
 
+        // Dispatches events on the calling thread until stop() is called,
+        // sleeping while the queue is empty
         void run();
-        void stop() { m_shouldStop = true; };
+        void stop();
+
+        // Dispatches every event that was queued when the call started, in
+        // one batch, and returns how many there were. Can be called once
+        // per frame instead of running the dispatcher on its own thread.
+        size_t processTick();
 
-        void processTick();
-        void registerCallback(EventType t, std::function<void(Event*)> cb, int priority = 0);
+        EventStats getStats() const;
+        void resetStats();
+
+        // When enabled for a type, runs of consecutive events of that type
+        // within a batch are merged with Event::coalesce() and dispatched
+        // once. Enabled by default for MouseMove, MouseScroll and
+        // WindowResize.
+        void setCoalescing(EventType t, bool enabled);
+
+        // Callbacks for an event type are called in ascending order of
+        // priority, and in registration order for equal priorities. The
+        // order only holds among callbacks with the same affinity, and
+        // Worker callbacks may run concurrently, even with themselves.
+        void registerCallback(EventType t, std::function<void(Event*)> cb, int priority = 0,
+            CallbackAffinity affinity = CallbackAffinity::Dispatcher);
+
+        // Runs the MainThread callbacks queued since the last call, on the
+        // calling thread. Called once per frame by Application::run(), so
+        // an override of run() has to call it too.
+        size_t runMainThreadCallbacks();
         // may include the option in the future to register by category as well as type,
         // but doing so would complicate the process of assigning priority to callbacks
     private:
         EventDispatcher();
 
         struct CallbackEntry {
-            EventType t;
             std::function<void(Event*)> cb;
             int priority;
-            CallbackEntry(EventType _t, std::function<void(Event*)> _cb, int p): t(_t), cb(_cb), priority(p) {};
+            CallbackAffinity affinity;
+            CallbackEntry(std::function<void(Event*)> _cb, int p, CallbackAffinity a): cb(_cb), priority(p), affinity(a) {};
+        };
+
+        // A copy of an event that outlives its queue slot, shared by every
+        // callback that runs off the dispatcher thread
+        class EventCopy
+        {
+        public:
+            explicit EventCopy(const Event& e) : m_event(e.copyTo(m_storage)) {};
+            ~EventCopy() { m_event->~Event(); };
+            EventCopy(const EventCopy&) = delete;
+            EventCopy& operator=(const EventCopy&) = delete;
+
+            Event* get() const { return m_event; };
+        private:
+            alignas(std::max_align_t) std::byte m_storage[ALKAHEST_EVENT_SLOT_SIZE];
+            Event* m_event;
         };
-        static bool sortCallbacksByPriority(const CallbackEntry &cb1, const CallbackEntry &cb2);
 
-        std::vector<CallbackEntry> m_callbacks;
+        // Each event type's callbacks, kept sorted by priority. Tables are
+        // never modified once published: registering a callback publishes
+        // a new copy, so the dispatcher can call into its own snapshot of
+        // the tables without holding a lock or copying per event.
+        using CallbackTable = std::vector<CallbackEntry>;
+        static constexpr size_t eventTypeCount = static_cast<size_t>(EventType::Count);
+
+        // A callback to run later on another thread. Holding the table
+        // keeps the entry alive if callbacks are registered meanwhile.
+        struct DeferredCallback {
+            std::shared_ptr<const CallbackTable> table;
+            const CallbackEntry* entry;
+            std::shared_ptr<EventCopy> event;
+        };
+
+        // Refreshes m_dispatchTables if a callback was registered since
+        // the last batch
+        void refreshDispatchTables();
+
+        std::array<std::shared_ptr<const CallbackTable>, eventTypeCount> m_callbacks;
+        std::atomic<uint64_t> m_callbacksVersion{0};
+
+        // Only touched by the thread dispatching
+        std::array<std::shared_ptr<const CallbackTable>, eventTypeCount> m_dispatchTables;
+        uint64_t m_dispatchVersion = 0;
+
         EventQueue* m_eqInstance;
-        bool m_shouldStop = false;
+        std::atomic<bool> m_shouldStop{false};
+
+        std::array<std::atomic<bool>, eventTypeCount> m_coalescing{};
+
+        std::mutex m_mainThreadMutex;
+        std::vector<DeferredCallback> m_mainThreadCallbacks;
+
+        std::atomic<uint64_t> m_dispatched{0};
+        std::atomic<uint64_t> m_coalesced{0};
+        std::atomic<uint64_t> m_batches{0};
+        std::atomic<uint64_t> m_totalLatencyNs{0};
+        std::atomic<uint64_t> m_maxLatencyNs{0};
 
         static EventDispatcher* m_pInstance;
     };
-}
\ No newline at end of file
+}
@@ -62,6 +62,15 @@ namespace Alkahest
         double getX() const { return m_X; };
         double getY() const { return m_Y; };
         std::string toString() const override { return "MouseMoveEvent: (" + std::to_string(m_X) + "," + std::to_string(m_Y) + ")"; };
+
+        // Only the latest position matters
+        bool coalesce(const Event& next) override
+        {
+            const MouseMoveEvent& e = static_cast<const MouseMoveEvent&>(next);
+            m_X = e.m_X;
+            m_Y = e.m_Y;
+            return true;
+        };
     private:
         double m_X, m_Y;
     };
@@ -74,6 +83,15 @@ namespace Alkahest
         double getX() const { return m_X; };
         double getY() const { return m_Y; };
         std::string toString() const override { return "MouseScrollEvent: (" + std::to_string(m_X) + "," + std::to_string(m_Y) + ")"; };
+
+        // Scroll offsets are deltas, so merged events add up
+        bool coalesce(const Event& next) override
+        {
+            const MouseScrollEvent& e = static_cast<const MouseScrollEvent&>(next);
+            m_X += e.m_X;
+            m_Y += e.m_Y;
+            return true;
+        };
     private:
         double m_X, m_Y;
     };
@@ -28,6 +28,15 @@ namespace Alkahest
         int getWidth() { return m_Width; }
         int getHeight() { return m_Height; }
         std::string toString() const override { return "WindowResizeEvent: (" + std::to_string(m_Width) + "x" + std::to_string(m_Height) + ")"; };
+
+        // Only the final size matters
+        bool coalesce(const Event& next) override
+        {
+            const WindowResizeEvent& e = static_cast<const WindowResizeEvent&>(next);
+            m_Width = e.m_Width;
+            m_Height = e.m_Height;
+            return true;
+        };
     private:
         // auto m_Window;
         int m_Width, m_Height;
@@ -0,0 +1,205 @@
+#include "jobsystem.h"
+#include "../log/log.h"
+
+namespace Alkahest
+{
+    JobSystem* JobSystem::m_pInstance = nullptr;
+
+    // Index of the worker running on this thread, so submit() and popJob()
+    // can find the thread's own queue
+    static constexpr size_t notAWorker = std::numeric_limits<size_t>::max();
+    static thread_local size_t s_workerIndex = notAWorker;
+
+    // Several worlds may start updating on different threads at once
+    static std::once_flag s_instanceOnce;
+
+    JobSystem *JobSystem::getInstance()
+    {
+        std::call_once(s_instanceOnce, []{
+            // Leave a core for the main thread, which also runs jobs
+            // whenever it waits on them
+            size_t cores = std::thread::hardware_concurrency();
+            m_pInstance = new JobSystem(cores > 1 ? cores - 1 : 0);
+        });
+        return m_pInstance;
+    }
+
+    JobSystem::JobSystem(size_t workerCount) : m_workerCount(workerCount)
+    {
+        logTrace("Starting job system with {} workers", workerCount);
+
+        for (size_t i = 0; i <= workerCount; i++)
+            m_queues.push_back(std::make_unique<WorkQueue>());
+
+        m_workers.reserve(workerCount);
+        for (size_t i = 0; i < workerCount; i++)
+            m_workers.emplace_back([this, i]{ workerLoop(i); });
+    }
+
+    JobSystem::~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> l(m_mtxSleep);
+            m_shouldStop = true;
+        }
+        m_cvSleep.notify_all();
+
+        for (std::thread& t : m_workers)
+            t.join();
+    }
+
+    void JobSystem::submit(Job job, JobCounter* counter)
+    {
+        if (counter != nullptr)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+        WorkQueue& q = s_workerIndex != notAWorker ? *m_queues[s_workerIndex] : *m_queues.back();
+        {
+            std::lock_guard<std::mutex> l(q.mtx);
+            q.jobs.push_back({ std::move(job), counter });
+        }
+        m_queuedJobs.fetch_add(1, std::memory_order_release);
+
+        // Taking the sleep lock orders this with a worker that is about to
+        // wait, so the notification can't be lost
+        bool waiting;
+        {
+            std::lock_guard<std::mutex> l(m_mtxSleep);
+            waiting = m_waiting > 0;
+        }
+        m_cvSleep.notify_one();
+        if (waiting)
+            m_cvWait.notify_all();
+    }
+
+    void JobSystem::wait(const JobCounter& counter)
+    {
+        while (counter.pending.load(std::memory_order_acquire) > 0)
+        {
+            QueuedJob j;
+            if (popJob(j))
+            {
+                runJob(j);
+                continue;
+            }
+
+            // Everything left is already running elsewhere
+            std::unique_lock<std::mutex> l(m_mtxSleep);
+            m_waiting++;
+            m_cvWait.wait(l, [this, &counter]{
+                return counter.pending.load(std::memory_order_acquire) == 0
+                    || m_queuedJobs.load(std::memory_order_acquire) > 0; });
+            m_waiting--;
+        }
+
+        if (counter.exception)
+            std::rethrow_exception(counter.exception);
+    }
+
+    void JobSystem::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+    {
+        grain = std::max<size_t>(grain, 1);
+
+        if (m_workerCount == 0 || count <= grain)
+        {
+            for (size_t begin = 0; begin < count; begin += grain)
+                fn(begin, std::min(begin + grain, count));
+            return;
+        }
+
+        JobCounter counter;
+        for (size_t begin = 0; begin < count; begin += grain)
+        {
+            size_t end = std::min(begin + grain, count);
+            submit([&fn, begin, end]{ fn(begin, end); }, &counter);
+        }
+        wait(counter);
+    }
+
+    bool JobSystem::popJob(QueuedJob& j)
+    {
+        size_t workerCount = m_workerCount;
+
+        // Newest job from our own queue first, as its data is most likely
+        // still in cache
+        if (s_workerIndex != notAWorker)
+        {
+            WorkQueue& own = *m_queues[s_workerIndex];
+            std::lock_guard<std::mutex> l(own.mtx);
+            if (!own.jobs.empty())
+            {
+                j = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        // Then the shared queue, then steal the oldest job of another worker
+        size_t start = s_workerIndex != notAWorker ? s_workerIndex + 1 : 0;
+        for (size_t k = 0; k <= workerCount; k++)
+        {
+            size_t victim = k == 0 ? workerCount : (start + k - 1) % workerCount;
+            if (victim == s_workerIndex)
+                continue;
+
+            WorkQueue& q = *m_queues[victim];
+            std::lock_guard<std::mutex> l(q.mtx);
+            if (!q.jobs.empty())
+            {
+                j = std::move(q.jobs.front());
+                q.jobs.pop_front();
+                m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // The counter is always released, even if the job throws, so the
+    // thread waiting on it can't hang. Jobs nobody waits on can only log.
+    void JobSystem::runJob(QueuedJob& j)
+    {
+        try
+        {
+            j.job();
+        }
+        catch (...)
+        {
+            if (j.counter == nullptr)
+                logError("Unhandled exception in a job!");
+            else if (!j.counter->failed.exchange(true, std::memory_order_relaxed))
+                j.counter->exception = std::current_exception();
+        }
+
+        if (j.counter != nullptr && j.counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            {
+                std::lock_guard<std::mutex> l(m_mtxSleep);
+            }
+            m_cvWait.notify_all();
+        }
+    }
+
+    void JobSystem::workerLoop(size_t index)
+    {
+        s_workerIndex = index;
+
+        while (true)
+        {
+            QueuedJob j;
+            if (popJob(j))
+            {
+                runJob(j);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> l(m_mtxSleep);
+            m_cvSleep.wait(l, [this]{
+                return m_shouldStop || m_queuedJobs.load(std::memory_order_acquire) > 0; });
+            if (m_shouldStop)
+                return;
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../../macros.h"
+
+namespace Alkahest
+{
+    using Job = std::function<void()>;
+
+    // Tracks a batch of submitted jobs so the submitter can wait for
+    // all of them to finish. The first exception thrown by one of the
+    // jobs is kept and rethrown by wait().
+    struct API JobCounter
+    {
+        std::atomic<uint32_t> pending{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr exception{};
+    };
+
+    // Work-stealing job pool. Every worker owns a queue that it pushes to
+    // and pops from at the back, while idle workers steal from the front
+    // of other workers' queues. Jobs submitted from outside the pool go
+    // to a shared queue that every worker drains.
+    class API JobSystem
+    {
+    public:
+        static JobSystem *getInstance();
+
+        ~JobSystem();
+
+        void submit(Job job, JobCounter* counter = nullptr);
+
+        // Blocks until every job tracked by the counter has finished, then
+        // rethrows the first exception any of them threw. The waiting
+        // thread runs queued jobs in the meantime, so waiting from inside
+        // a job can't deadlock the pool, and sleeps while there are none.
+        void wait(const JobCounter& counter);
+
+        // Splits [0, count) into consecutive ranges of `grain` elements and
+        // runs fn(begin, end) for each range across the pool, returning once
+        // all of them are done. The ranges only depend on count and grain,
+        // never on the number of workers, so results are deterministic.
+        void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+        size_t getWorkerCount() const { return m_workerCount; };
+    private:
+        JobSystem(size_t workerCount);
+
+        struct QueuedJob
+        {
+            Job job;
+            JobCounter* counter;
+        };
+
+        struct alignas(64) WorkQueue
+        {
+            std::mutex mtx;
+            std::deque<QueuedJob> jobs;
+        };
+
+        bool popJob(QueuedJob& j);
+        void runJob(QueuedJob& j);
+        void workerLoop(size_t index);
+
+        const size_t m_workerCount;
+        std::vector<std::thread> m_workers;
+        // One queue per worker, followed by the shared queue for jobs
+        // submitted from threads outside the pool
+        std::vector<std::unique_ptr<WorkQueue>> m_queues;
+        std::atomic<size_t> m_queuedJobs{0};
+
+        std::mutex m_mtxSleep;
+        std::condition_variable m_cvSleep;
+        // Threads in wait() sleep here until a job is queued or one of
+        // the counters reaches zero
+        std::condition_variable m_cvWait;
+        size_t m_waiting = 0;
+        bool m_shouldStop = false;
+
+        static JobSystem* m_pInstance;
+    };
+}
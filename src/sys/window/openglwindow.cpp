@@ -142,30 +142,63 @@ namespace Alkahest
             data.width = width;
             data.height = height;
 
-            WindowResizeEvent* e = new WindowResizeEvent(width, height);
-            data.eventCallback(e);
+            WindowResizeEvent e(width, height);
+            data.eventCallback(&e);
         });
 
         glfwSetWindowCloseCallback(m_window, [](GLFWwindow* window){
             WindowData& data = *static_cast<WindowData*>(glfwGetWindowUserPointer(window));
-            WindowCloseEvent* e = new WindowCloseEvent();
-            data.eventCallback(e);
+            WindowCloseEvent e;
+            data.eventCallback(&e);
         });
 
         glfwSetKeyCallback(m_window, [](GLFWwindow* window, int key, int scancode, int action, int mods){
             Input::setKeyState(static_cast<Key>(key), static_cast<KeyState>(action));
+
+            WindowData& data = *static_cast<WindowData*>(glfwGetWindowUserPointer(window));
+            if (action == GLFW_RELEASE)
+            {
+                KeyUpEvent e(key);
+                data.eventCallback(&e);
+            }
+            else
+            {
+                KeyDownEvent e(key, action == GLFW_REPEAT);
+                data.eventCallback(&e);
+            }
         });
 
         glfwSetMouseButtonCallback(m_window, [](GLFWwindow* window, int button, int action, int mods){
             Input::setMouseButtonState(static_cast<MouseButton>(button), static_cast<ButtonState>(action));
+
+            WindowData& data = *static_cast<WindowData*>(glfwGetWindowUserPointer(window));
+            if (action == GLFW_RELEASE)
+            {
+                MouseButtonUpEvent e(button);
+                data.eventCallback(&e);
+            }
+            else
+            {
+                MouseButtonDownEvent e(button, action == GLFW_REPEAT);
+                data.eventCallback(&e);
+            }
         });
 
         glfwSetCursorPosCallback(m_window, [](GLFWwindow* window, double x, double y){
             Input::setMousePos(x, y);
+
+            // Fires once per polled cursor update, merged by the dispatcher
+            WindowData& data = *static_cast<WindowData*>(glfwGetWindowUserPointer(window));
+            MouseMoveEvent e(x, y);
+            data.eventCallback(&e);
         });
 
         glfwSetScrollCallback(m_window, [](GLFWwindow* window, double x, double y){
             Input::setMouseScroll(x, y);
+
+            WindowData& data = *static_cast<WindowData*>(glfwGetWindowUserPointer(window));
+            MouseScrollEvent e(x, y);
+            data.eventCallback(&e);
         });
 
         m_modelShader = Shader::create("shaders/default.vert", "shaders/default.frag");
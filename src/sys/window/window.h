@@ -42,6 +42,7 @@ namespace Alkahest
         virtual int getHeight() const = 0;
         virtual void setVSync(bool vsync) = 0;
         virtual bool isVSync() const = 0;
+        // The event passed to the callback is only valid during the call
         virtual void setEventCallback(std::function<void(Event*)> e) = 0;
         virtual void setMainCamera(Ref<Camera> c) = 0;
         virtual void initializeInput() = 0;
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "../macros.h"
+
+#include <cmath>
+
+#if defined(ALKAHEST_SIMD_AVX)
+#include <immintrin.h>
+#elif defined(ALKAHEST_SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace Alkahest
+{
+    namespace Simd
+    {
+        // Each lane type wraps one register width of floats behind the same
+        // small set of operations, so a kernel can be written once as a
+        // template and compiled for whichever instruction set is available.
+        // Loads and stores are unaligned.
+        struct NOT_EXPORTED Scalar
+        {
+            using Float = float;
+            using Mask = bool;
+            static constexpr size_t width = 1;
+
+            static Float load(const float* p) { return *p; };
+            static void store(float* p, Float v) { *p = v; };
+            static Float set(float v) { return v; };
+
+            static Float add(Float a, Float b) { return a + b; };
+            static Float sub(Float a, Float b) { return a - b; };
+            static Float mul(Float a, Float b) { return a * b; };
+            static Float round(Float a) { return std::nearbyint(a); };
+
+            static Mask greater(Float a, Float b) { return a > b; };
+            static Float select(Mask m, Float a, Float b) { return m ? a : b; };
+        };
+
+#if defined(ALKAHEST_SIMD_SSE2)
+        struct NOT_EXPORTED SSE
+        {
+            using Float = __m128;
+            using Mask = __m128;
+            static constexpr size_t width = 4;
+
+            static Float load(const float* p) { return _mm_loadu_ps(p); };
+            static void store(float* p, Float v) { _mm_storeu_ps(p, v); };
+            static Float set(float v) { return _mm_set1_ps(v); };
+
+            static Float add(Float a, Float b) { return _mm_add_ps(a, b); };
+            static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); };
+            static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); };
+            // SSE2 has no rounding instruction, but the conversion to int
+            // rounds to nearest. Floats of magnitude 2^23 and up are already
+            // whole and would overflow the conversion past 2^31, so they
+            // are passed through as they are.
+            static Float round(Float a)
+            {
+                Float magnitude = _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+                Mask whole = _mm_cmpge_ps(magnitude, _mm_set1_ps(8388608.0f));
+                return select(whole, a, _mm_cvtepi32_ps(_mm_cvtps_epi32(a)));
+            };
+
+            static Mask greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); };
+            static Float select(Mask m, Float a, Float b)
+            {
+                return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+            };
+        };
+#endif
+
+#if defined(ALKAHEST_SIMD_AVX)
+        struct NOT_EXPORTED AVX
+        {
+            using Float = __m256;
+            using Mask = __m256;
+            static constexpr size_t width = 8;
+
+            static Float load(const float* p) { return _mm256_loadu_ps(p); };
+            static void store(float* p, Float v) { _mm256_storeu_ps(p, v); };
+            static Float set(float v) { return _mm256_set1_ps(v); };
+
+            static Float add(Float a, Float b) { return _mm256_add_ps(a, b); };
+            static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); };
+            static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); };
+            static Float round(Float a)
+            {
+                return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            };
+
+            static Mask greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); };
+            static Float select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b, a, m); };
+        };
+#endif
+
+        // The widest lane type the target supports
+#if defined(ALKAHEST_SIMD_AVX)
+        using Widest = AVX;
+#elif defined(ALKAHEST_SIMD_SSE2)
+        using Widest = SSE;
+#else
+        using Widest = Scalar;
+#endif
+
+        // Computes sin(pi * x) and cos(pi * x) for every lane. x is reduced
+        // to [-0.5, 0.5] first, where the Taylor series below are accurate
+        // to within a few float ULPs, so any finite input is fine.
+        template<typename L>
+        inline void sinCosPi(typename L::Float x, typename L::Float& s, typename L::Float& c)
+        {
+            using F = typename L::Float;
+
+            // sin(pi * x) and cos(pi * x) repeat every 2 units of x
+            F u = L::sub(x, L::mul(L::set(2.0f), L::round(L::mul(x, L::set(0.5f)))));
+
+            // Reflecting around +-0.5 keeps sin and flips the sign of cos
+            typename L::Mask high = L::greater(u, L::set(0.5f));
+            typename L::Mask low = L::greater(L::set(-0.5f), u);
+            u = L::select(high, L::sub(L::set(1.0f), u), L::select(low, L::sub(L::set(-1.0f), u), u));
+            F sign = L::select(high, L::set(-1.0f), L::select(low, L::set(-1.0f), L::set(1.0f)));
+
+            F a = L::mul(u, L::set(3.14159265358979f));
+            F a2 = L::mul(a, a);
+
+            F sp = L::set(-2.50521084e-8f);
+            sp = L::add(L::mul(sp, a2), L::set(2.75573192e-6f));
+            sp = L::add(L::mul(sp, a2), L::set(-1.98412698e-4f));
+            sp = L::add(L::mul(sp, a2), L::set(8.33333333e-3f));
+            sp = L::add(L::mul(sp, a2), L::set(-1.66666667e-1f));
+            sp = L::add(L::mul(sp, a2), L::set(1.0f));
+            s = L::mul(sp, a);
+
+            F cp = L::set(2.08767570e-9f);
+            cp = L::add(L::mul(cp, a2), L::set(-2.75573192e-7f));
+            cp = L::add(L::mul(cp, a2), L::set(2.48015873e-5f));
+            cp = L::add(L::mul(cp, a2), L::set(-1.38888889e-3f));
+            cp = L::add(L::mul(cp, a2), L::set(4.16666667e-2f));
+            cp = L::add(L::mul(cp, a2), L::set(-0.5f));
+            cp = L::add(L::mul(cp, a2), L::set(1.0f));
+            c = L::mul(cp, sign);
+        }
+    }
+}
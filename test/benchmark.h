@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <fmt/format.h>
+
+namespace Alkahest
+{
+    namespace Bench
+    {
+        // Runs fn once to warm up, then `iterations` more times, and prints
+        // the mean wall time per iteration. Returns that mean in ns.
+        inline double run(const std::string& name, size_t iterations, const std::function<void()>& fn)
+        {
+            fn();
+
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < iterations; i++)
+                fn();
+            auto end = std::chrono::steady_clock::now();
+
+            double ns = std::chrono::duration<double, std::nano>(end - start).count()
+                / static_cast<double>(iterations);
+            fmt::print("{:<48} {:>14.1f} ns/iter\n", name, ns);
+            return ns;
+        }
+
+        // As above, for an fn that handles `items` things per call, and
+        // also prints the mean time per item
+        inline double run(const std::string& name, size_t iterations, size_t items, const std::function<void()>& fn)
+        {
+            double ns = run(name, iterations, fn);
+            fmt::print("{:<48} {:>14.2f} ns/item\n", "", ns / static_cast<double>(items));
+            return ns;
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#include "benchmark.h"
+#include "ecs/managers/ecsmanager.h"
+
+#include <random>
+
+// Times the core ECS operations at 1k, 10k and 100k entities, each size in
+// a fresh World. Build once with and once without ENABLE_ARCHETYPE_STORAGE
+// to compare the two storage backends.
+
+using namespace Alkahest;
+
+struct Position : Component
+{
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+};
+
+struct Velocity : Component
+{
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+};
+
+struct Health : Component
+{
+    int value = 100;
+};
+
+struct Frozen : Component {};
+
+// Only exists so its query group has to be kept up to date
+class MovementSystem : public System {};
+
+// Keeps the compiler from dropping loops whose results are never used
+static volatile float sink;
+
+static void benchmark(size_t entityCount)
+{
+    const size_t iterations = std::max<size_t>(2000000 / entityCount, 5);
+
+    World world;
+    world.registerComponent<Position>();
+    world.registerComponent<Velocity>();
+    world.registerComponent<Health>();
+    world.registerComponent<Frozen>();
+    world.registerSystem<MovementSystem>();
+    world.setSystemMask<MovementSystem>(world.getComponentMask<Position, Velocity>(),
+        world.getComponentMask<Frozen>());
+
+    fmt::print("\n{} entities, {} iterations\n", entityCount, iterations);
+    auto name = [&](const char* operation) { return fmt::format("{} ({})", operation, entityCount); };
+
+    std::vector<Entity> entities;
+    entities.reserve(entityCount);
+    Bench::run(name("create + destroy"), iterations, entityCount, [&]() {
+        for (size_t i = 0; i < entityCount; i++)
+            entities.push_back(world.createEntity());
+        for (Entity e : entities)
+            world.destroyEntity(e);
+        entities.clear();
+    });
+
+    for (size_t i = 0; i < entityCount; i++)
+    {
+        float f = static_cast<float>(i);
+        entities.push_back(world.createEntity());
+        world.addComponent(entities[i], Position{ {}, f, -f, 0.0f });
+        world.addComponent(entities[i], Health{});
+    }
+
+    Bench::run(name("add + remove component"), iterations, entityCount, [&]() {
+        for (Entity e : entities)
+            world.addComponent(e, Velocity{ {}, 1.0f, 0.0f, 0.0f });
+        for (Entity e : entities)
+            world.removeComponent<Velocity>(e);
+    });
+
+    std::vector<Entity> shuffled = entities;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(42));
+
+    Bench::run(name("readComponent, random order"), iterations, entityCount, [&]() {
+        float sum = 0.0f;
+        for (Entity e : shuffled)
+            sum += world.readComponent<Position>(e).x;
+        sink = sum;
+    });
+
+    Bench::run(name("getComponent, random order"), iterations, entityCount, [&]() {
+        for (Entity e : shuffled)
+            world.getComponent<Position>(e).y += 1.0f;
+    });
+
+    Bench::run(name("view<Position>"), iterations, entityCount, [&]() {
+        float sum = 0.0f;
+        world.view<Position>().each([&](const Position& p) { sum += p.x; });
+        sink = sum;
+    });
+
+    for (size_t i = 0; i < entityCount; i++)
+        world.addComponent(entities[i], Velocity{ {}, 1.0f, 0.5f, 0.25f });
+
+    Bench::run(name("view<Position, Velocity, Health>"), iterations, entityCount, [&]() {
+        world.view<Position, Velocity, Health>().each([](Position& p, const Velocity& v, const Health& h) {
+            if (h.value > 0)
+            {
+                p.x += v.x;
+                p.y += v.y;
+                p.z += v.z;
+            }
+        });
+    });
+
+    // Every other entity leaves and rejoins MovementSystem's group
+    Bench::run(name("system membership churn"), iterations, entityCount / 2, [&]() {
+        for (size_t i = 0; i < entityCount; i += 2)
+            world.addComponent(entities[i], Frozen{});
+        for (size_t i = 0; i < entityCount; i += 2)
+            world.removeComponent<Frozen>(entities[i]);
+    });
+
+    size_t members = world.getSystem<MovementSystem>()->getEntityCount();
+    if (members != entityCount)
+    {
+        fmt::print("MovementSystem has {} entities, expected {}\n", members, entityCount);
+        std::exit(1);
+    }
+}
+
+int main()
+{
+#if defined(ALKAHEST_ECS_ARCHETYPE_STORAGE)
+    fmt::print("Archetype storage\n");
+#else
+    fmt::print("Sparse set storage\n");
+#endif
+
+    for (size_t entityCount : { 1000, 10000, 100000 })
+        benchmark(entityCount);
+
+    return 0;
+}
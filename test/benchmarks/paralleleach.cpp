@@ -0,0 +1,87 @@
+#include "benchmark.h"
+#include "ecs/managers/ecsmanager.h"
+
+// Compares the serial System::processAll() path against View::each and
+// View::parallelEach for a physics-style integration over 50k entities
+
+using namespace Alkahest;
+using Components::TransformComponent;
+
+struct Velocity : Component
+{
+    glm::vec3 Value = { 0.0f, 0.0f, 0.0f };
+};
+
+static constexpr float dt = 1.0f / 60.0f;
+
+class IntegrateSystem : public System
+{
+public:
+    void process(Entity e) override
+    {
+        TransformComponent& t = ECSManager::getComponent<TransformComponent>(e);
+        const Velocity& v = ECSManager::readComponent<Velocity>(e);
+        t.Position += v.Value * dt;
+    }
+};
+
+static void integrate(TransformComponent& t, const Velocity& v)
+{
+    t.Position += v.Value * dt;
+}
+
+int main()
+{
+    constexpr size_t entityCount = 50000;
+    constexpr size_t iterations = 50;
+
+    ECSManager::init();
+    ECSManager::registerComponent<Velocity>();
+    ECSManager::registerSystem<IntegrateSystem>();
+    ECSManager::setSystemMask<IntegrateSystem>(ECSManager::getComponentMask<TransformComponent, Velocity>());
+
+    IntegrateSystem& system = *ECSManager::getSystem<IntegrateSystem>();
+    std::vector<Entity> entities;
+    for (size_t i = 0; i < entityCount; i++)
+    {
+        Entity e = ECSManager::createEntity();
+        float f = static_cast<float>(i);
+        ECSManager::addComponentToEntity(e, TransformComponent{});
+        ECSManager::addComponentToEntity(e, Velocity{ {}, { f, -f, 0.5f * f } });
+        entities.push_back(e);
+    }
+
+    auto reset = [&]() {
+        ECSManager::view<TransformComponent>().each([](TransformComponent& t) { t.Position = {}; });
+    };
+    auto snapshot = [&]() {
+        std::vector<glm::vec3> positions;
+        for (Entity e : entities)
+            positions.push_back(ECSManager::readComponent<TransformComponent>(e).Position);
+        return positions;
+    };
+
+    fmt::print("{} entities, {} workers\n", entityCount, JobSystem::getInstance()->getWorkerCount());
+
+    reset();
+    Bench::run("System::processAll (serial)", iterations, [&]() { system.processAll(); });
+    std::vector<glm::vec3> serial = snapshot();
+
+    reset();
+    Bench::run("View::each", iterations, [&]() {
+        ECSManager::view<TransformComponent, Velocity>().each(integrate);
+    });
+
+    reset();
+    Bench::run("View::parallelEach", iterations, [&]() {
+        ECSManager::view<TransformComponent, Velocity>().parallelEach(integrate);
+    });
+    std::vector<glm::vec3> parallel = snapshot();
+
+    bool match = std::equal(serial.begin(), serial.end(), parallel.begin(), [](const glm::vec3& a, const glm::vec3& b) {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    });
+    fmt::print("Serial and parallel results {}\n", match ? "match" : "DIFFER");
+
+    return match ? 0 : 1;
+}
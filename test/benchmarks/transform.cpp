@@ -0,0 +1,97 @@
+#include "benchmark.h"
+#include "ecs/managers/ecsmanager.h"
+#include "renderer/transform.h"
+
+// Compares building every model matrix with Transform::getMatrix(), as
+// OpenGLModel::draw() does, against Systems::TransformSystem over 50k
+// entities, a quarter of which are children of the entity before them
+
+using namespace Alkahest;
+using Components::ParentComponent;
+using Components::TransformComponent;
+using Systems::TransformSystem;
+
+static float maxDifference(const glm::mat4& a, const glm::mat4& b)
+{
+    float difference = 0.0f;
+    for (int column = 0; column < 4; column++)
+    {
+        for (int row = 0; row < 4; row++)
+            difference = std::max(difference, std::abs(a[column][row] - b[column][row]));
+    }
+    return difference;
+}
+
+int main()
+{
+    constexpr size_t entityCount = 50000;
+    constexpr size_t iterations = 50;
+
+    ECSManager::init();
+
+    std::vector<Transform> transforms(entityCount);
+    std::vector<Entity> entities;
+    for (size_t i = 0; i < entityCount; i++)
+    {
+        float f = static_cast<float>(i);
+        Transform& transform = transforms[i];
+        transform.Position = glm::vec3(f, -0.5f * f, 2.0f);
+        transform.Rotation = glm::vec3(std::fmod(f * 0.001f, 1.0f), -std::fmod(f * 0.0007f, 1.0f), std::fmod(f * 0.013f, 1.0f));
+        transform.Scale = glm::vec3(1.0f + (i % 3), 1.0f, 0.5f);
+
+        Entity e = ECSManager::createEntity();
+        ECSManager::addComponentToEntity(e, TransformComponent{ {}, transform.Position, transform.Rotation, transform.Scale });
+        if (i % 4 == 3)
+            ECSManager::addComponentToEntity(e, ParentComponent{ {}, entities.back() });
+        entities.push_back(e);
+    }
+
+    TransformSystem& system = *ECSManager::getSystem<TransformSystem>();
+    std::vector<glm::mat4> matrices(entityCount);
+
+    fmt::print("{} entities, {}-wide SIMD\n", entityCount, Simd::Widest::width);
+
+    double perCall = Bench::run("Transform::getMatrix (per call)", iterations, [&]() {
+        for (size_t i = 0; i < entityCount; i++)
+            matrices[i] = transforms[i].getMatrix();
+    });
+
+    double all = Bench::run("TransformSystem::update (all dirty)", iterations, [&]() {
+        system.invalidate();
+        ECSManager::update();
+    });
+
+    Bench::run("TransformSystem::update (none dirty)", iterations, [&]() {
+        ECSManager::update();
+    });
+
+    auto perSecond = [](double ns) { return static_cast<double>(entityCount) / (ns * 1e-9); };
+    fmt::print("{:<48} {:>14.3e} matrices/s\n", "Transform::getMatrix", perSecond(perCall));
+    fmt::print("{:<48} {:>14.3e} matrices/s\n", "TransformSystem", perSecond(all));
+
+    // Children were given their parent's matrix on top of their own
+    float difference = 0.0f;
+    for (size_t i = 0; i < entityCount; i++)
+    {
+        glm::mat4 expected = i % 4 == 3 ? matrices[i - 1] * matrices[i] : matrices[i];
+        difference = std::max(difference, maxDifference(expected, system.getWorldMatrix(entities[i])) /
+            std::max(1.0f, std::abs(expected[3][0]) + std::abs(expected[3][1])));
+    }
+
+    bool match = difference < 1e-4f;
+    fmt::print("Per-call and system results {} (max relative difference {})\n", match ? "match" : "DIFFER", difference);
+
+    // Recycling index 0 gives an ID equal to the entity limit, which must
+    // still get a slot of its own
+    World world;
+    world.destroyEntity(world.createEntity());
+    Entity recycled = world.createEntity();
+    world.addComponent(recycled, TransformComponent{ {}, glm::vec3(1.0f, 2.0f, 3.0f), glm::vec3(0.0f), glm::vec3(1.0f) });
+    world.update();
+
+    const glm::mat4& recycledMatrix = world.getSystem<TransformSystem>()->getWorldMatrix(recycled);
+    bool recycledMatch = recycledMatrix[3][0] == 1.0f && recycledMatrix[3][1] == 2.0f && recycledMatrix[3][2] == 3.0f;
+    fmt::print("Recycled entity 0 {}\n", recycledMatch ? "transformed" : "NOT TRANSFORMED");
+
+    return match && recycledMatch ? 0 : 1;
+}